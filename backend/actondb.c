@@ -62,6 +62,7 @@ int no_queue_cols = 1;                  // 2;
 #define ACTORS_TABLE    (WORD)0
 #define MSGS_TABLE      (WORD)1
 #define MSG_QUEUE       (WORD)2
+#define KEYS_TABLE      (WORD)3
 
 //WORD state_table_key = (WORD) 0;
 //WORD queue_table_key = (WORD) 1;
@@ -234,6 +235,10 @@ int create_state_schema(db_t * db, unsigned int * fastrandstate)
 
 	printf("Test %s - %s (%d)\n", "create MSGS_TABLE", ret==0?"OK":"FAILED", ret);
 
+	ret = db_create_table(KEYS_TABLE, db_schema, db, fastrandstate);
+
+	printf("Test %s - %s (%d)\n", "create KEYS_TABLE", ret==0?"OK":"FAILED", ret);
+
 	return ret;
 }
 
@@ -594,10 +599,11 @@ int handle_range_read_query(range_read_query * q,
 
 // Queue message handlers:
 
-int get_queue_ack_packet(int status, queue_query_message * q,
+int get_queue_ack_value_packet(int status, int64_t value, queue_query_message * q,
 					void ** snd_buf, unsigned * snd_msg_len, vector_clock * vc)
 {
 	ack_message * ack = init_ack_message(q->cell_address, status, q->txnid, q->nonce);
+	ack->value = value;
 
 #if (VERBOSE_RPC > 0)
 	char print_buff[1024];
@@ -612,6 +618,12 @@ int get_queue_ack_packet(int status, queue_query_message * q,
 	return ret;
 }
 
+int get_queue_ack_packet(int status, queue_query_message * q,
+					void ** snd_buf, unsigned * snd_msg_len, vector_clock * vc)
+{
+	return get_queue_ack_value_packet(status, 0, q, snd_buf, snd_msg_len, vc);
+}
+
 int get_queue_read_response_packet(snode_t* start_row, snode_t* end_row, int no_results,
 									int64_t new_read_head, int status, db_schema_t * schema,
 									queue_query_message * q,
@@ -745,6 +757,61 @@ int handle_enqueue(queue_query_message * q, db_t * db, unsigned int * fastrandst
 	return status;
 }
 
+// Apply a batch of enqueues to (possibly) several queues, taking each queue's enqueue lock once:
+
+int handle_enqueue_batch(queue_query_message * q, db_t * db, unsigned int * fastrandstate)
+{
+	assert(q->no_cells > 0 && q->cells != NULL);
+
+	int status = 0;
+	short * done = (short *) calloc(q->no_cells, sizeof(short));
+	int64_t * column_values = NULL;
+	int no_cols = q->cells[0].no_columns;
+
+	for(int i=0;i<q->no_cells && status == 0;i++)
+	{
+		if(done[i])
+			continue;
+
+		int64_t queue_id = q->cells[i].keys[0];
+		int no_entries = 0;
+
+		for(int j=i;j<q->no_cells;j++)
+		{
+			if(done[j] || q->cells[j].keys[0] != queue_id)
+				continue;
+
+			assert(q->cells[j].no_columns == no_cols && q->cells[j].last_blob_size == 0);
+			no_entries++;
+		}
+
+		// Entries for the same queue keep their relative order from the batch:
+
+		column_values = (int64_t *) realloc(column_values, no_entries * no_cols * sizeof(int64_t));
+		int k = 0;
+
+		for(int j=i;j<q->no_cells;j++)
+		{
+			if(done[j] || q->cells[j].keys[0] != queue_id)
+				continue;
+
+			memcpy(column_values + k * no_cols, q->cells[j].columns, no_cols * sizeof(int64_t));
+			done[j] = 1;
+			k++;
+		}
+
+		if(q->txnid == NULL) // Enqueue out of txn
+			status = enqueue_batch((WORD *) column_values, no_entries, no_cols, (WORD) q->cell_address->table_key, (WORD) queue_id, 1, db, fastrandstate);
+		else // Enqueue in txn
+			status = enqueue_batch_in_txn((WORD *) column_values, no_entries, no_cols, (WORD) q->cell_address->table_key, (WORD) queue_id, q->txnid, db, fastrandstate);
+	}
+
+	free(column_values);
+	free(done);
+
+	return status;
+}
+
 int handle_read_queue(queue_query_message * q,
 						int * entries_read, int64_t * new_read_head, vector_clock ** prh_version,
 						snode_t** start_row, snode_t** end_row, db_schema_t ** schema,
@@ -776,6 +843,15 @@ int handle_consume_queue(queue_query_message * q, db_t * db, unsigned int * fast
 									q->queue_index, q->txnid, db, fastrandstate);
 }
 
+int handle_consume_advance_queue(queue_query_message * q, int64_t * new_consume_head, db_t * db, unsigned int * fastrandstate)
+{
+	assert(q->txnid != NULL); // Consume-and-advance is only supported in txns
+
+	return consume_advance_queue_in_txn((WORD) q->consumer_id, (WORD) q->shard_id, (WORD) q->app_id,
+								(WORD) q->cell_address->table_key, (WORD) q->cell_address->keys[0],
+								(int) q->queue_index, new_consume_head, q->txnid, db, fastrandstate);
+}
+
 // Txn messages handlers:
 
 int get_txn_ack_packet(int status, txn_message * q,
@@ -1095,6 +1171,13 @@ int handle_client_message(int childfd, int msg_len, db_t * db, unsigned int * fa
 
     					break;
     				}
+    				case QUERY_TYPE_ENQUEUE_BATCH:
+    				{
+    					status = handle_enqueue_batch(qm, db, fastrandstate);
+    					status = get_queue_ack_packet(status, qm, &tmp_out_buf, &snd_msg_len, vc);
+
+    					break;
+    				}
     				case QUERY_TYPE_READ_QUEUE:
     				{
     					int entries_read = 0;
@@ -1116,6 +1199,14 @@ int handle_client_message(int childfd, int msg_len, db_t * db, unsigned int * fa
     					status = get_queue_ack_packet(status, qm, &tmp_out_buf, &snd_msg_len, vc);
     					break;
     				}
+    				case QUERY_TYPE_CONSUME_ADVANCE_QUEUE:
+    				{
+    					int64_t new_consume_head = -1;
+    					status = handle_consume_advance_queue(qm, &new_consume_head, db, fastrandstate);
+    					// Ack carries the status, and the new consume head in its 64 bit value field:
+    					status = get_queue_ack_value_packet(status, new_consume_head, qm, &tmp_out_buf, &snd_msg_len, vc);
+    					break;
+    				}
     				default:
     				{
     					assert(0);
@@ -1473,6 +1473,64 @@ int remote_enqueue_in_txn(WORD * column_values, int no_cols, WORD blob, size_t b
 	return !(ok_status >= db->quorum_size);
 }
 
+// Enqueue no_entries entries (of no_cols columns each, laid out back to back in column_values) in one round trip.
+// Entry i goes to queue queue_ids[i]:
+
+int remote_enqueue_batch_in_txn(WORD * queue_ids, WORD * column_values, int no_cols, int no_entries, WORD table_key, uuid_t * txnid, remote_db_t * db)
+{
+	unsigned len = 0;
+	void * tmp_out_buf = NULL;
+
+	queue_query_message * q = build_enqueue_batch_in_txn(queue_ids, column_values, no_cols, no_entries, table_key, txnid, get_nonce(db));
+	int success = serialize_queue_message(q, (void **) &tmp_out_buf, &len, 1, NULL);
+
+	if(db->servers->no_items < db->quorum_size)
+	{
+		fprintf(stderr, "No quorum (%d/%d servers alive)\n", db->servers->no_items, db->replication_factor);
+		return NO_QUORUM_ERR;
+	}
+	remote_server * rs = (remote_server *) (HEAD(db->servers))->value;
+
+#if CLIENT_VERBOSITY > 0
+	char print_buff[1024];
+	to_string_queue_message(q, (char *) print_buff);
+	printf("Sending queue message to server %s: %s\n", rs->id, print_buff);
+#endif
+
+	// Send packet to server and wait for reply:
+
+	msg_callback * mc = NULL;
+	success = send_packet_wait_replies_sync(tmp_out_buf, len, q->nonce, &mc, db);
+	assert(success == 0);
+	free_queue_message(q);
+
+	if(mc->no_replies < db->quorum_size)
+	{
+		fprintf(stderr, "No quorum (%d/%d replies received)\n", mc->no_replies, db->replication_factor);
+		delete_msg_callback(mc->nonce, db);
+		return NO_QUORUM_ERR;
+	}
+
+	int ok_status = 0;
+
+	for(int i=0;i<mc->no_replies;i++)
+	{
+		assert(mc->reply_types[i] == RPC_TYPE_ACK);
+		ack_message * ack = (ack_message *) mc->replies[i];
+		if(ack->status == 0)
+			ok_status++;
+
+#if CLIENT_VERBOSITY > 0
+		to_string_ack_message(ack, (char *) print_buff);
+		printf("Got back response from server %s: %s\n", rs->id, print_buff);
+#endif
+	}
+
+	delete_msg_callback(mc->nonce, db);
+
+	return !(ok_status >= db->quorum_size);
+}
+
 int remote_read_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 		int max_entries, int * entries_read, int64_t * new_read_head,
 		snode_t** start_row, snode_t** end_row, uuid_t * txnid,
@@ -1609,6 +1667,77 @@ int remote_consume_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WO
 	return !(ok_status >= db->quorum_size);
 }
 
+// Consume the next (up to) max_entries entries of the queue in one round trip, without reading them first.
+// The servers advance the consume head themselves and send it back in new_consume_head.
+// Returns 0 on success, or else the error code of a server, or NO_QUORUM_ERR:
+
+int remote_consume_advance_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
+					int max_entries, int64_t * new_consume_head, uuid_t * txnid, remote_db_t * db)
+{
+	unsigned len = 0;
+	void * tmp_out_buf = NULL;
+
+	queue_query_message * q = build_consume_advance_queue_in_txn(consumer_id, shard_id, app_id, table_key, queue_id, max_entries, txnid, get_nonce(db));
+	int success = serialize_queue_message(q, (void **) &tmp_out_buf, &len, 1, NULL);
+
+	if(db->servers->no_items < db->quorum_size)
+	{
+		fprintf(stderr, "No quorum (%d/%d servers alive)\n", db->servers->no_items, db->replication_factor);
+		return NO_QUORUM_ERR;
+	}
+	remote_server * rs = (remote_server *) (HEAD(db->servers))->value;
+
+#if CLIENT_VERBOSITY > 0
+	char print_buff[1024];
+	to_string_queue_message(q, (char *) print_buff);
+	printf("Sending queue message to server %s: %s\n", rs->id, print_buff);
+#endif
+
+	// Send packet to server and wait for reply:
+
+	msg_callback * mc = NULL;
+	success = send_packet_wait_replies_sync(tmp_out_buf, len, q->nonce, &mc, db);
+	assert(success == 0);
+	free_queue_message(q);
+
+	if(mc->no_replies < db->quorum_size)
+	{
+		fprintf(stderr, "No quorum (%d/%d replies received)\n", mc->no_replies, db->replication_factor);
+		delete_msg_callback(mc->nonce, db);
+		return NO_QUORUM_ERR;
+	}
+
+	int ok_status = 0, err_status = NO_QUORUM_ERR;
+	*new_consume_head = -1;
+
+	for(int i=0;i<mc->no_replies;i++)
+	{
+		assert(mc->reply_types[i] == RPC_TYPE_ACK);
+		ack_message * ack = (ack_message *) mc->replies[i];
+		if(ack->status == 0)
+		{
+			if(ok_status == 0)
+				*new_consume_head = ack->value;
+			else if(ack->value != *new_consume_head)
+				fprintf(stderr, "Replicas disagree on new consume head (%" PRId64 " != %" PRId64 ")\n", ack->value, *new_consume_head);
+			ok_status++;
+		}
+		else
+		{
+			err_status = ack->status;
+		}
+
+#if CLIENT_VERBOSITY > 0
+		to_string_ack_message(ack, (char *) print_buff);
+		printf("Got back response from server %s: %s\n", rs->id, print_buff);
+#endif
+	}
+
+	delete_msg_callback(mc->nonce, db);
+
+	return (ok_status >= db->quorum_size)?(0):(err_status);
+}
+
 int remote_subscribe_queue(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 						queue_callback * callback, int64_t * prev_read_head, int64_t * prev_consume_head,
 						remote_db_t * db)
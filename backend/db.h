@@ -49,6 +49,9 @@ typedef void *WORD;
 #define QUERY_TYPE_READ_QUEUE_RESPONSE 16
 #define QUERY_TYPE_QUEUE_NOTIFICATION 17
 
+#define QUERY_TYPE_CONSUME_ADVANCE_QUEUE 18
+#define QUERY_TYPE_ENQUEUE_BATCH 19
+
 #define VERBOSE_BACKEND 0
 #define MAX_PRINT_BUFF 128 * 1024
 
@@ -2231,7 +2231,7 @@ const ProtobufCMessageDescriptor read_query_message__descriptor =
   (ProtobufCMessageInit) read_query_message__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor ack_message__field_descriptors[5] =
+static const ProtobufCFieldDescriptor ack_message__field_descriptors[6] =
 {
   {
     "cell_address",
@@ -2293,6 +2293,18 @@ static const ProtobufCFieldDescriptor ack_message__field_descriptors[5] =
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "value",
+    6,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_INT64,
+    offsetof(AckMessage, has_value),
+    offsetof(AckMessage, value),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned ack_message__field_indices_by_name[] = {
   0,   /* field[0] = cell_address */
@@ -2300,11 +2312,12 @@ static const unsigned ack_message__field_indices_by_name[] = {
   3,   /* field[3] = nonce */
   1,   /* field[1] = status */
   2,   /* field[2] = txnid */
+  5,   /* field[5] = value */
 };
 static const ProtobufCIntRange ack_message__number_ranges[1 + 1] =
 {
   { 1, 0 },
-  { 0, 5 }
+  { 0, 6 }
 };
 const ProtobufCMessageDescriptor ack_message__descriptor =
 {
@@ -2314,7 +2327,7 @@ const ProtobufCMessageDescriptor ack_message__descriptor =
   "AckMessage",
   "",
   sizeof(AckMessage),
-  5,
+  6,
   ack_message__field_descriptors,
   ack_message__field_indices_by_name,
   1,  ack_message__number_ranges,
@@ -251,10 +251,15 @@ struct  _AckMessage
   ProtobufCBinaryData txnid;
   int64_t nonce;
   int32_t mtype;
+  /*
+   * CONSUME_ADVANCE_QUEUE: the new consume head
+   */
+  protobuf_c_boolean has_value;
+  int64_t value;
 };
 #define ACK_MESSAGE__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&ack_message__descriptor) \
-    , NULL, 0, {0,NULL}, 0, 0 }
+    , NULL, 0, {0,NULL}, 0, 0, 0, 0 }
 
 
 struct  _RangeReadQueryMessage
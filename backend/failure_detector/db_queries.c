@@ -650,6 +650,7 @@ ack_message * init_ack_message(cell_address * cell_address, int status, uuid_t *
 	ca->status = status;
 	ca->txnid = txnid;
 	ca->nonce = nonce;
+	ca->value = 0;
 	return ca;
 }
 
@@ -668,6 +669,7 @@ ack_message * init_ack_message_copy(cell_address * cell_address, int status, uui
 		ca->txnid = NULL;
 	}
 	ca->nonce = nonce;
+	ca->value = 0;
 	return ca;
 }
 
@@ -694,12 +696,15 @@ void init_ack_message_msg(AckMessage * msg, ack_message * ca, CellAddressMessage
 	}
 	msg->nonce = ca->nonce;
 	msg->cell_address = cell_address_msg;
+	msg->has_value = (ca->value != 0);
+	msg->value = ca->value;
 }
 
 ack_message * init_ack_message_from_msg(AckMessage * msg)
 {
 	cell_address * cell_address = (msg->cell_address != NULL)?(init_cell_address_from_msg(msg->cell_address)):(NULL);
 	ack_message * c = init_ack_message_copy(cell_address, msg->status, (uuid_t *) msg->txnid.data, msg->nonce);
+	c->value = msg->has_value ? msg->value : 0;
 	return c;
 }
 
@@ -782,7 +787,7 @@ char * to_string_ack_message(ack_message * ca, char * msg_buff)
 	else
 		uuid_str[0]='\0';
 
-	sprintf(crt_ptr, "AckMessage(status=%d, txnid=%s, nonce=%" PRId64 ", ", ca->status, uuid_str, ca->nonce);
+	sprintf(crt_ptr, "AckMessage(status=%d, txnid=%s, nonce=%" PRId64 ", value=%" PRId64 ", ", ca->status, uuid_str, ca->nonce, ca->value);
 	crt_ptr += strlen(crt_ptr);
 
 	if(ca->cell_address != NULL)
@@ -798,7 +803,7 @@ char * to_string_ack_message(ack_message * ca, char * msg_buff)
 
 int equals_ack_message(ack_message * ca1, ack_message * ca2)
 {
-	if(ca1->nonce != ca2->nonce || ca1->status != ca2->status ||
+	if(ca1->nonce != ca2->nonce || ca1->status != ca2->status || ca1->value != ca2->value ||
 		!equals_cell_address(ca1->cell_address, ca2->cell_address))
 		return 0;
 
@@ -1046,6 +1051,20 @@ queue_query_message * build_enqueue_in_txn(WORD * column_values, int no_cols, WO
 	return init_enqueue_message(c, entry, 1, txnid, nonce);
 }
 
+// Entries of a batch can go to different queues of the same table; each cell carries its destination queue as its only key:
+
+queue_query_message * build_enqueue_batch_in_txn(WORD * queue_ids, WORD * column_values, int no_cols, int no_entries, WORD table_key, uuid_t * txnid, int64_t nonce)
+{
+	assert(no_entries > 0);
+
+	cell_address * c = init_cell_address_single_key_copy((int64_t) table_key, (int64_t) queue_ids[0]);
+	cell * entries = (cell *) malloc(no_entries * sizeof(cell));
+	for(int i=0;i<no_entries;i++)
+		copy_cell(entries + i, (int64_t) table_key, (int64_t *) (queue_ids + i), 1, (int64_t *) (column_values + i * no_cols), no_cols, NULL, 0, NULL);
+
+	return init_enqueue_batch_message(c, entries, no_entries, txnid, nonce);
+}
+
 queue_query_message * build_read_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 												int max_entries, uuid_t * txnid, int64_t nonce)
 {
@@ -1061,6 +1080,13 @@ queue_query_message * build_consume_queue_in_txn(WORD consumer_id, WORD shard_id
 	return init_consume_queue_message(c, (int64_t) app_id, (int64_t) shard_id, (int64_t) consumer_id, new_consume_head, txnid, nonce);
 }
 
+queue_query_message * build_consume_advance_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
+													int max_entries, uuid_t * txnid, int64_t nonce)
+{
+	cell_address * c = init_cell_address_single_key_copy((int64_t) table_key, (int64_t) queue_id);
+	return init_consume_advance_queue_message(c, (int64_t) app_id, (int64_t) shard_id, (int64_t) consumer_id, (int64_t) max_entries, txnid, nonce);
+}
+
 queue_query_message * build_create_queue_in_txn(WORD table_key, WORD queue_id, uuid_t * txnid, int64_t nonce)
 {
 	cell_address * c = init_cell_address_single_key_copy((int64_t) table_key, (int64_t) queue_id);
@@ -1129,6 +1155,15 @@ queue_query_message * init_enqueue_message(cell_address * cell_address, cell * c
 	return ca;
 }
 
+queue_query_message * init_enqueue_batch_message(cell_address * cell_address, cell * cells, int no_cells, uuid_t * txnid, int64_t nonce)
+{
+	queue_query_message * ca = init_query_message_basic(cell_address, txnid, nonce);
+	ca->msg_type = QUERY_TYPE_ENQUEUE_BATCH;
+	ca->cells = cells;
+	ca->no_cells = no_cells;
+	return ca;
+}
+
 queue_query_message * init_read_queue_message(cell_address * cell_address, int app_id, int shard_id, int consumer_id, int64_t max_entries, uuid_t * txnid, int64_t nonce)
 {
 	queue_query_message * ca = init_query_message_basic(cell_address, txnid, nonce);
@@ -1151,6 +1186,17 @@ queue_query_message * init_consume_queue_message(cell_address * cell_address, in
 	return ca;
 }
 
+queue_query_message * init_consume_advance_queue_message(cell_address * cell_address, int app_id, int shard_id, int consumer_id, int64_t max_entries, uuid_t * txnid, int64_t nonce)
+{
+	queue_query_message * ca = init_query_message_basic(cell_address, txnid, nonce);
+	ca->msg_type = QUERY_TYPE_CONSUME_ADVANCE_QUEUE;
+	ca->queue_index = max_entries;
+	ca->app_id = app_id;
+	ca->shard_id = shard_id;
+	ca->consumer_id = consumer_id;
+	return ca;
+}
+
 queue_query_message * init_read_queue_response(cell_address * cell_address, cell * cells, int no_cells, int app_id, int shard_id, int consumer_id, int64_t new_read_head, short status, uuid_t * txnid, int64_t nonce)
 {
 	queue_query_message * ca = init_query_message_basic(cell_address, txnid, nonce);
@@ -1271,6 +1317,17 @@ queue_query_message * init_queue_message_from_msg(QueueQueryMessage * msg)
 
 			return init_enqueue_message(cell_address, cells, msg->n_cells, (uuid_t *) msg->txnid.data, msg->nonce);
 		}
+		case QUERY_TYPE_ENQUEUE_BATCH:
+		{
+			if(msg->n_cells > 0)
+			{
+				cells = (cell *) malloc(msg->n_cells * sizeof(cell));
+				for(int i=0;i<msg->n_cells;i++)
+					copy_cell_from_msg(cells + i, msg->cells[i]);
+			}
+
+			return init_enqueue_batch_message(cell_address, cells, msg->n_cells, (uuid_t *) msg->txnid.data, msg->nonce);
+		}
 		case QUERY_TYPE_READ_QUEUE:
 		{
 			return init_read_queue_message(cell_address, msg->app_id, msg->shard_id, msg->consumer_id, msg->queue_index, (uuid_t *) msg->txnid.data, msg->nonce);
@@ -1279,6 +1336,10 @@ queue_query_message * init_queue_message_from_msg(QueueQueryMessage * msg)
 		{
 			return init_consume_queue_message(cell_address, msg->app_id, msg->shard_id, msg->consumer_id, msg->queue_index, (uuid_t *) msg->txnid.data, msg->nonce);
 		}
+		case QUERY_TYPE_CONSUME_ADVANCE_QUEUE:
+		{
+			return init_consume_advance_queue_message(cell_address, msg->app_id, msg->shard_id, msg->consumer_id, msg->queue_index, (uuid_t *) msg->txnid.data, msg->nonce);
+		}
 		case QUERY_TYPE_READ_QUEUE_RESPONSE:
 		{
 			if(msg->n_cells > 0)
@@ -1443,6 +1504,11 @@ char * to_string_queue_message(queue_query_message * ca, char * msg_buff)
 			sprintf(crt_ptr, "Enqueue(txnid=%s, nonce=%" PRId64 ", no_entries=%d, ", uuid_str, ca->nonce, ca->no_cells);
 			break;
 		}
+		case QUERY_TYPE_ENQUEUE_BATCH:
+		{
+			sprintf(crt_ptr, "EnqueueBatch(txnid=%s, nonce=%" PRId64 ", no_entries=%d, ", uuid_str, ca->nonce, ca->no_cells);
+			break;
+		}
 		case QUERY_TYPE_READ_QUEUE:
 		{
 			sprintf(crt_ptr, "ReadQueue(txnid=%s, nonce=%" PRId64 ", app_id=%d, shard_id=%d, consumer_id=%d, max_items=%" PRId64 ", ", uuid_str, ca->nonce, ca->app_id, ca->shard_id, ca->consumer_id, ca->queue_index);
@@ -1453,6 +1519,11 @@ char * to_string_queue_message(queue_query_message * ca, char * msg_buff)
 			sprintf(crt_ptr, "ConsumeQueue(txnid=%s, nonce=%" PRId64 ", app_id=%d, shard_id=%d, consumer_id=%d, new_consume_head=%" PRId64 ", ", uuid_str, ca->nonce, ca->app_id, ca->shard_id, ca->consumer_id, ca->queue_index);
 			break;
 		}
+		case QUERY_TYPE_CONSUME_ADVANCE_QUEUE:
+		{
+			sprintf(crt_ptr, "ConsumeAdvanceQueue(txnid=%s, nonce=%" PRId64 ", app_id=%d, shard_id=%d, consumer_id=%d, max_items=%" PRId64 ", ", uuid_str, ca->nonce, ca->app_id, ca->shard_id, ca->consumer_id, ca->queue_index);
+			break;
+		}
 		case QUERY_TYPE_READ_QUEUE_RESPONSE:
 		{
 			sprintf(crt_ptr, "ReadQueueResponse(txnid=%s, nonce=%" PRId64 ", app_id=%d, shard_id=%d, consumer_id=%d, no_entries=%d, new_read_head=%" PRId64 ", status=%d, ", uuid_str, ca->nonce, ca->app_id, ca->shard_id, ca->consumer_id, ca->no_cells, ca->queue_index, ca->status);
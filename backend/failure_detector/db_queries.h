@@ -87,6 +87,7 @@ typedef struct ack_message
 	int status;
 	uuid_t * txnid;
 	int64_t nonce;
+	int64_t value; // For CONSUME_ADVANCE_QUEUE, the new consume head
 } ack_message;
 
 ack_message * init_ack_message(cell_address * cell_address, int status, uuid_t * txnid, int64_t nonce);
@@ -149,7 +150,7 @@ typedef struct queue_query_message
 	cell * cells;
 	int no_cells;
 
-	// For READ_QUEUE (== max_entries) and CONSUME_QUEUE (== new_consume_head):
+	// For READ_QUEUE and CONSUME_ADVANCE_QUEUE (== max_entries) and CONSUME_QUEUE (== new_consume_head):
 
 	int64_t queue_index;
 
@@ -165,10 +166,13 @@ typedef struct queue_query_message
 queue_query_message * build_create_queue_in_txn(WORD table_key, WORD queue_id, uuid_t * txnid, int64_t nonce);
 queue_query_message * build_delete_queue_in_txn(WORD table_key, WORD queue_id, uuid_t * txnid, int64_t nonce);
 queue_query_message * build_enqueue_in_txn(WORD * column_values, int no_cols, WORD blob, size_t blob_size, WORD table_key, WORD queue_id, uuid_t * txnid, int64_t nonce);
+queue_query_message * build_enqueue_batch_in_txn(WORD * queue_ids, WORD * column_values, int no_cols, int no_entries, WORD table_key, uuid_t * txnid, int64_t nonce);
 queue_query_message * build_read_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 												int max_entries, uuid_t * txnid, int64_t nonce);
 queue_query_message * build_consume_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 													int64_t new_consume_head, uuid_t * txnid, int64_t nonce);
+queue_query_message * build_consume_advance_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
+													int max_entries, uuid_t * txnid, int64_t nonce);
 queue_query_message * build_subscribe_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id, uuid_t * txnid, int64_t nonce);
 queue_query_message * build_unsubscribe_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id, uuid_t * txnid, int64_t nonce);
 
@@ -177,8 +181,10 @@ queue_query_message * init_delete_queue_message(cell_address * cell_address, uui
 queue_query_message * init_subscribe_queue_message(cell_address * cell_address, int app_id, int shard_id, int consumer_id, uuid_t * txnid, int64_t nonce);
 queue_query_message * init_unsubscribe_queue_message(cell_address * cell_address, int app_id, int shard_id, int consumer_id, uuid_t * txnid, int64_t nonce);
 queue_query_message * init_enqueue_message(cell_address * cell_address, cell * cells, int no_cells, uuid_t * txnid, int64_t nonce);
+queue_query_message * init_enqueue_batch_message(cell_address * cell_address, cell * cells, int no_cells, uuid_t * txnid, int64_t nonce);
 queue_query_message * init_read_queue_message(cell_address * cell_address, int app_id, int shard_id, int consumer_id, int64_t max_entries, uuid_t * txnid, int64_t nonce);
 queue_query_message * init_consume_queue_message(cell_address * cell_address, int app_id, int shard_id, int consumer_id, int64_t new_consume_head, uuid_t * txnid, int64_t nonce);
+queue_query_message * init_consume_advance_queue_message(cell_address * cell_address, int app_id, int shard_id, int consumer_id, int64_t max_entries, uuid_t * txnid, int64_t nonce);
 queue_query_message * init_read_queue_response(cell_address * cell_address, cell * cells, int no_cells, int app_id, int shard_id, int consumer_id, int64_t new_read_head, short status, uuid_t * txnid, int64_t nonce);
 queue_query_message * init_queue_notification(cell_address * cell_address, cell * cells, int no_cells, int app_id, int shard_id, int consumer_id, int64_t new_no_entries, short status, uuid_t * txnid, int64_t nonce);
 void free_queue_message(queue_query_message * ca);
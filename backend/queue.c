@@ -160,48 +160,11 @@ int notify_remote_queue_subscribers(WORD table_key, WORD queue_id, db_t * db)
 }
 
 
-int enqueue(WORD * column_values, int no_cols, size_t last_blob_size, WORD table_key, WORD queue_id, short use_lock, db_t * db, unsigned int * fastrandstate)
-{
-	db_table_t * table = get_table_by_key(table_key, db);
-	int ret = 0;
-
-	if(table == NULL)
-		return DB_ERR_NO_TABLE; // Table doesn't exist
-
-	snode_t * node = skiplist_search(table->rows, queue_id);
-	if(node == NULL)
-		return DB_ERR_NO_QUEUE; // Queue doesn't exist
-
-	db_row_t * db_row = (db_row_t *) (node->value);
-
-	if(use_lock)
-	{
-		pthread_mutex_lock(db_row->enqueue_lock);
-	}
-
-	int64_t entry_id = db_row->no_entries;
-	db_row->no_entries++;
-
-	if(use_lock)
-	{
-		pthread_mutex_unlock(db_row->enqueue_lock);
-	}
-
-	// Add queue_id as partition key and entry_id as clustering key:
-
-	WORD * queue_column_values = (WORD *) malloc((no_cols + 2) * sizeof(WORD));
-	queue_column_values[0]=queue_id;
-	queue_column_values[1]=(WORD) entry_id;
-	for(int64_t i=2;i<no_cols + 2;i++)
-		queue_column_values[i]=column_values[i-2];
-
-	int status = table_insert(queue_column_values, no_cols+2, 1, last_blob_size, NULL, table, fastrandstate);
+// Notify subscribers of queue_id if they haven't been notified:
 
-#if (VERBOSITY > 0)
-	printf("BACKEND: Inserted queue entry %" PRId64 " in queue %" PRId64 "/%" PRId64 ", status=%d\n", entry_id, (int64_t) table_key, (int64_t) queue_id, status);
-#endif
-
-	// Notify subscribers if they haven't been notified:
+static void notify_queue_subscribers(db_row_t * db_row, WORD table_key, WORD queue_id)
+{
+	int ret = 0, status = 0;
 
 	for(snode_t * cell=HEAD(db_row->consumer_state);cell!=NULL;cell=NEXT(cell))
 	{
@@ -272,6 +235,99 @@ int enqueue(WORD * column_values, int no_cols, size_t last_blob_size, WORD table
 #endif
 		}
 	}
+}
+
+int enqueue(WORD * column_values, int no_cols, size_t last_blob_size, WORD table_key, WORD queue_id, short use_lock, db_t * db, unsigned int * fastrandstate)
+{
+	db_table_t * table = get_table_by_key(table_key, db);
+
+	if(table == NULL)
+		return DB_ERR_NO_TABLE; // Table doesn't exist
+
+	snode_t * node = skiplist_search(table->rows, queue_id);
+	if(node == NULL)
+		return DB_ERR_NO_QUEUE; // Queue doesn't exist
+
+	db_row_t * db_row = (db_row_t *) (node->value);
+
+	if(use_lock)
+	{
+		pthread_mutex_lock(db_row->enqueue_lock);
+	}
+
+	int64_t entry_id = db_row->no_entries;
+	db_row->no_entries++;
+
+	if(use_lock)
+	{
+		pthread_mutex_unlock(db_row->enqueue_lock);
+	}
+
+	// Add queue_id as partition key and entry_id as clustering key:
+
+	WORD * queue_column_values = (WORD *) malloc((no_cols + 2) * sizeof(WORD));
+	queue_column_values[0]=queue_id;
+	queue_column_values[1]=(WORD) entry_id;
+	for(int64_t i=2;i<no_cols + 2;i++)
+		queue_column_values[i]=column_values[i-2];
+
+	int status = table_insert(queue_column_values, no_cols+2, 1, last_blob_size, NULL, table, fastrandstate);
+
+#if (VERBOSITY > 0)
+	printf("BACKEND: Inserted queue entry %" PRId64 " in queue %" PRId64 "/%" PRId64 ", status=%d\n", entry_id, (int64_t) table_key, (int64_t) queue_id, status);
+#endif
+
+	notify_queue_subscribers(db_row, table_key, queue_id);
+
+	return status;
+}
+
+// Enqueue no_entries entries of no_cols columns each (laid out back to back in column_values),
+// reserving their entry ids with a single lock acquisition:
+
+int enqueue_batch(WORD * column_values, int no_entries, int no_cols, WORD table_key, WORD queue_id, short use_lock, db_t * db, unsigned int * fastrandstate)
+{
+	db_table_t * table = get_table_by_key(table_key, db);
+	int status = 0;
+
+	if(table == NULL)
+		return DB_ERR_NO_TABLE; // Table doesn't exist
+
+	snode_t * node = skiplist_search(table->rows, queue_id);
+	if(node == NULL)
+		return DB_ERR_NO_QUEUE; // Queue doesn't exist
+
+	db_row_t * db_row = (db_row_t *) (node->value);
+
+	if(use_lock)
+	{
+		pthread_mutex_lock(db_row->enqueue_lock);
+	}
+
+	int64_t first_entry_id = db_row->no_entries;
+	db_row->no_entries += no_entries;
+
+	if(use_lock)
+	{
+		pthread_mutex_unlock(db_row->enqueue_lock);
+	}
+
+	for(int j=0;j<no_entries && status == 0;j++)
+	{
+		WORD * queue_column_values = (WORD *) malloc((no_cols + 2) * sizeof(WORD));
+		queue_column_values[0]=queue_id;
+		queue_column_values[1]=(WORD) (first_entry_id + j);
+		for(int64_t i=2;i<no_cols + 2;i++)
+			queue_column_values[i]=column_values[j * no_cols + i - 2];
+
+		status = table_insert(queue_column_values, no_cols+2, 1, 0, NULL, table, fastrandstate);
+	}
+
+#if (VERBOSITY > 0)
+	printf("BACKEND: Inserted queue entries %" PRId64 "-%" PRId64 " in queue %" PRId64 "/%" PRId64 ", status=%d\n", first_entry_id, first_entry_id + no_entries - 1, (int64_t) table_key, (int64_t) queue_id, status);
+#endif
+
+	notify_queue_subscribers(db_row, table_key, queue_id);
 
 	return status;
 }
@@ -349,6 +405,13 @@ int set_private_consume_head(WORD consumer_id, WORD shard_id, WORD app_id, WORD
 
 	cs->private_consume_head = new_consume_head;
 
+	// Consume-and-advance ops consume entries that were never read by this consumer:
+
+	pthread_mutex_lock(db_row->read_lock);
+	if(cs->private_read_head < new_consume_head)
+		cs->private_read_head = new_consume_head;
+	pthread_mutex_unlock(db_row->read_lock);
+
 	assert(version != NULL);
 
 	update_or_replace_vc(&(cs->pch_version), version);
@@ -356,6 +419,30 @@ int set_private_consume_head(WORD consumer_id, WORD shard_id, WORD app_id, WORD
 	return 0;
 }
 
+int get_private_consume_head(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
+							int64_t * consume_head, int64_t * no_entries, db_t * db)
+{
+	db_table_t * table = get_table_by_key(table_key, db);
+	if(table == NULL)
+		return DB_ERR_NO_TABLE; // Table doesn't exist
+	snode_t * node = skiplist_search(table->rows, queue_id);
+	if(node == NULL)
+		return DB_ERR_NO_QUEUE; // Queue doesn't exist
+
+	db_row_t * db_row = (db_row_t *) (node->value);
+
+	snode_t * consumer_node = skiplist_search(db_row->consumer_state, consumer_id);
+	if(consumer_node == NULL)
+		return DB_ERR_NO_CONSUMER; // Consumer doesn't exist
+
+	consumer_state * cs = (consumer_state *) (consumer_node->value);
+
+	*consume_head = cs->private_consume_head;
+	*no_entries = db_row->no_entries;
+
+	return 0;
+}
+
 int read_queue(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 		int max_entries, int * entries_read, int64_t * new_read_head, vector_clock ** prh_version,
 		snode_t** start_row, snode_t** end_row, short use_lock,
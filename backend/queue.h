@@ -24,6 +24,7 @@
 #define QUEUE_NOTIF_DELETED 1
 
 int enqueue(WORD * column_values, int no_cols, size_t last_blob_size, WORD table_key, WORD queue_id, short use_lock, db_t * db, unsigned int * fastrandstate);
+int enqueue_batch(WORD * column_values, int no_entries, int no_cols, WORD table_key, WORD queue_id, short use_lock, db_t * db, unsigned int * fastrandstate);
 int read_queue(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 		int max_entries, int * entries_read, int64_t * new_read_head, vector_clock ** prh_version,
 		snode_t** start_row, snode_t** end_row, short use_lock,
@@ -55,5 +56,7 @@ int set_private_read_head(WORD consumer_id, WORD shard_id, WORD app_id, WORD tab
 							int64_t new_read_head, vector_clock * version, short use_lock, db_t * db);
 int set_private_consume_head(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 							int64_t new_consume_head, vector_clock * version, db_t * db);
+int get_private_consume_head(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
+							int64_t * consume_head, int64_t * no_entries, db_t * db);
 
 #endif /* BACKEND_QUEUE_H_ */
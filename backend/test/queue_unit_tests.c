@@ -21,7 +21,7 @@
 #include <string.h>
 #include <time.h>
 
-#include "queue.h"
+#include "txns.h"
 
 int no_cols = 2;
 int no_items = 10;
@@ -304,6 +304,135 @@ void * consumer_replay(void * cargs)
 	return (void *) ret;
 }
 
+// Consume-and-advance a fresh consumer through the whole queue in one txn, without reading it first:
+
+int test_consume_advance(db_t * db, unsigned int * fastrandstate)
+{
+	pthread_cond_t signal = PTHREAD_COND_INITIALIZER;
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	WORD consumer_id = (WORD) 2, shard_id = (WORD) 0, app_id = (WORD) 0;
+	int64_t prev_read_head = -1, prev_consume_head = -1, new_consume_head = -1, no_entries = 0;
+	int max_entries = 4, expected_heads = 0, ret = 0;
+
+	queue_callback qc;
+	qc.lock = &lock;
+	qc.signal = &signal;
+	qc.callback = consumer_callback;
+
+	ret = subscribe_queue(consumer_id, shard_id, app_id, table_key, queue_id, &qc,
+							&prev_read_head, &prev_consume_head, 1, db, fastrandstate);
+	if(ret)
+		return ret;
+
+	uuid_t * txnid = new_txn(db, fastrandstate);
+
+	for(int64_t expected_head = max_entries - 1;;expected_head += max_entries)
+	{
+		if(expected_head > no_items - 1)
+			expected_head = no_items - 1;
+
+		ret = consume_advance_queue_in_txn(consumer_id, shard_id, app_id, table_key, queue_id,
+											max_entries, &new_consume_head, txnid, db, fastrandstate);
+		if(ret == DB_ERR_QUEUE_COMPLETE)
+			break;
+		if(ret != 0 || new_consume_head != expected_head)
+			return -1;
+		expected_heads++;
+	}
+
+	if(new_consume_head != no_items - 1 || expected_heads != (no_items + max_entries - 1) / max_entries)
+		return -2;
+
+	int node_ids[] = {0};
+	int64_t counters[] = {0};
+	vector_clock * vc = init_vc(1, node_ids, counters, 0);
+
+	ret = commit_txn(txnid, vc, db, fastrandstate);
+	if(ret != VAL_STATUS_COMMIT)
+		return -3;
+
+	ret = get_private_consume_head(consumer_id, shard_id, app_id, table_key, queue_id, &new_consume_head, &no_entries, db);
+	if(ret != 0 || new_consume_head != no_items - 1)
+		return -4;
+
+	// Read head must have been moved past the consumed entries too:
+
+	int entries_read = 0;
+	int64_t new_read_head = -1;
+	vector_clock * prh_version = NULL;
+	snode_t * start_row, * end_row;
+
+	ret = read_queue(consumer_id, shard_id, app_id, table_key, queue_id,
+						max_entries, &entries_read, &new_read_head, &prh_version,
+						&start_row, &end_row, 1, db);
+	if(entries_read != 0 || new_read_head != no_items - 1)
+		return -5;
+
+	return unsubscribe_queue(consumer_id, shard_id, app_id, table_key, queue_id, 1, db);
+}
+
+// Enqueue batches to a fresh queue, both directly and in a txn, and read them all back:
+
+int test_enqueue_batch(db_t * db, unsigned int * fastrandstate)
+{
+	pthread_cond_t signal = PTHREAD_COND_INITIALIZER;
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	WORD batch_queue_id = (WORD) 1, consumer_id = (WORD) 0, shard_id = (WORD) 0, app_id = (WORD) 0;
+	int64_t prev_read_head = -1, prev_consume_head = -1, new_read_head = -1;
+	WORD column_values[5 * 2];
+	int ret = 0;
+
+	for(int i=0;i<5 * no_cols;i++)
+		column_values[i] = (WORD) (int64_t) i;
+
+	queue_callback qc;
+	qc.lock = &lock;
+	qc.signal = &signal;
+	qc.callback = consumer_callback;
+
+	ret = create_queue(table_key, batch_queue_id, NULL, 1, db, fastrandstate);
+	if(ret)
+		return ret;
+
+	ret = subscribe_queue(consumer_id, shard_id, app_id, table_key, batch_queue_id, &qc,
+							&prev_read_head, &prev_consume_head, 1, db, fastrandstate);
+	if(ret)
+		return ret;
+
+	ret = enqueue_batch(column_values, 3, no_cols, table_key, batch_queue_id, 1, db, fastrandstate);
+	if(ret)
+		return -1;
+
+	uuid_t * txnid = new_txn(db, fastrandstate);
+
+	ret = enqueue_batch_in_txn(column_values + 3 * no_cols, 2, no_cols, table_key, batch_queue_id, txnid, db, fastrandstate);
+	if(ret)
+		return -2;
+
+	int node_ids[] = {0};
+	int64_t counters[] = {0};
+	vector_clock * vc = init_vc(1, node_ids, counters, 0);
+
+	ret = commit_txn(txnid, vc, db, fastrandstate);
+	if(ret != VAL_STATUS_COMMIT)
+		return -3;
+
+	int entries_read = 0;
+	vector_clock * prh_version = NULL;
+	snode_t * start_row, * end_row;
+
+	ret = read_queue(consumer_id, shard_id, app_id, table_key, batch_queue_id,
+						10, &entries_read, &new_read_head, &prh_version,
+						&start_row, &end_row, 1, db);
+	if(entries_read != 5 || new_read_head != 4 || (int64_t) end_row->key != 4)
+		return -4;
+
+	ret = unsubscribe_queue(consumer_id, shard_id, app_id, table_key, batch_queue_id, 1, db);
+	if(ret)
+		return ret;
+
+	return delete_queue(table_key, batch_queue_id, NULL, 1, db, fastrandstate);
+}
 
 int main(int argc, char **argv) {
 	unsigned int seed;
@@ -415,6 +544,16 @@ int main(int argc, char **argv) {
 	// Test read head sanity after replay on C2:
 	printf("Test %s - %s (%d)\n", "read_head_replay", ((int) cargs_replay.read_head_after_replay)==(cargs_replay.no_enqueues - 1)?"OK":"FAILED", ret);
 
+	// Test consume-and-advance:
+
+	ret = test_consume_advance(db, &seed);
+	printf("Test %s - %s (%d)\n", "consume_advance", ret==0?"OK":"FAILED", ret);
+
+	// Test batched enqueues:
+
+	ret = test_enqueue_batch(db, &seed);
+	printf("Test %s - %s (%d)\n", "enqueue_batch", ret==0?"OK":"FAILED", ret);
+
 	// Test delete queue:
 
 	ret = delete_queue(table_key, queue_id, NULL, 1, db, &seed);
@@ -534,6 +534,17 @@ int add_enqueue_to_txn(WORD * column_values, int no_cols, size_t blob_size, WORD
 	return skiplist_insert(ts->write_set, (WORD) tw, (WORD) tw, fastrandstate);
 }
 
+int add_enqueue_batch_to_txn(WORD * column_values, int no_entries, int no_cols, WORD table_key, WORD queue_id, txn_state * ts, unsigned int * fastrandstate)
+{
+	txn_write * tw = get_txn_queue_op(QUERY_TYPE_ENQUEUE, column_values, no_entries * no_cols, 0, table_key, queue_id,
+						NULL, NULL, NULL, -1, NULL, -1, (int64_t) ts->write_set->no_items);
+	tw->no_cols = no_cols;
+	tw->no_entries = no_entries;
+
+	 // A batch is a single write set entry, persisted with one enqueue_batch() on commit:
+	return skiplist_insert(ts->write_set, (WORD) tw, (WORD) tw, fastrandstate);
+}
+
 int add_read_queue_to_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 						int64_t new_read_head, vector_clock * prh_version, txn_state * ts, unsigned int * fastrandstate)
 {
@@ -34,6 +34,7 @@ typedef struct txn_write
 
 	int64_t new_read_head;	// read_queue (out)
 	int64_t new_consume_head; // consume_queue (in)
+	int no_entries; // enqueue_batch (in), column_values then holds no_entries rows of no_cols each
 
 	vector_clock * prh_version;
 //	vector_clock * pch_version;
@@ -136,6 +137,7 @@ int add_index_range_read_to_txn(int idx_idx, WORD* start_idx_key, WORD* end_idx_
 // Queue ops:
 
 int add_enqueue_to_txn(WORD * column_values, int no_cols, size_t blob_size, WORD table_key, WORD queue_id, txn_state * ts, unsigned int * fastrandstate);
+int add_enqueue_batch_to_txn(WORD * column_values, int no_entries, int no_cols, WORD table_key, WORD queue_id, txn_state * ts, unsigned int * fastrandstate);
 int add_read_queue_to_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 							int64_t new_read_head, vector_clock * prh_version, txn_state * ts, unsigned int * fastrandstate);
 int add_consume_queue_to_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
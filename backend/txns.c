@@ -435,6 +435,8 @@ int persist_write(txn_write * tw, vector_clock * version, db_t * db, unsigned in
 		}
 		case QUERY_TYPE_ENQUEUE:
 		{
+			if(tw->no_entries > 0)
+				return enqueue_batch(tw->column_values, tw->no_entries, tw->no_cols, tw->table_key, tw->queue_id, 1, db, fastrandstate);
 			return enqueue(tw->column_values, tw->no_cols, tw->blob_size, tw->table_key, tw->queue_id, 1, db, fastrandstate);
 		}
 		case QUERY_TYPE_READ_QUEUE:
@@ -719,6 +721,15 @@ int enqueue_in_txn(WORD * column_values, int no_cols, size_t blob_size, WORD tab
 	return add_enqueue_to_txn(column_values, no_cols, blob_size, table_key, queue_id, ts, fastrandstate);
 }
 
+int enqueue_batch_in_txn(WORD * column_values, int no_entries, int no_cols, WORD table_key, WORD queue_id, uuid_t * txnid, db_t * db, unsigned int * fastrandstate)
+{
+	txn_state * ts = get_txn_state(txnid, db);
+	if(ts == NULL)
+		return -2; // No such txn
+
+	return add_enqueue_batch_to_txn(column_values, no_entries, no_cols, table_key, queue_id, ts, fastrandstate);
+}
+
 int read_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 		int max_entries, int * entries_read, int64_t * new_read_head,
 		snode_t** start_row, snode_t** end_row, uuid_t * txnid,
@@ -771,6 +782,54 @@ int consume_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD tabl
 			new_consume_head, ts, fastrandstate);
 }
 
+// Consume the next (up to) max_entries queue entries after the consume head seen by this txn,
+// without reading them first. Returns the new consume head in new_consume_head:
+
+int consume_advance_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
+					int max_entries, int64_t * new_consume_head, uuid_t * txnid, db_t * db, unsigned int * fastrandstate)
+{
+	txn_state * ts = get_txn_state(txnid, db);
+	if(ts == NULL)
+		return -2; // No such txn
+
+	int64_t prev_consume_head = -1, no_entries = 0;
+
+	int ret = get_private_consume_head(consumer_id, shard_id, app_id, table_key, queue_id, &prev_consume_head, &no_entries, db);
+	if(ret != 0)
+		return ret;
+
+	// Lookup previous consume in this txn's write set:
+
+	for(snode_t * write_op_n=HEAD(ts->write_set); write_op_n!=NULL; write_op_n=NEXT(write_op_n))
+	{
+		if(write_op_n->value != NULL)
+		{
+			txn_write * tw = (txn_write *) write_op_n->value;
+
+			if(tw->query_type == QUERY_TYPE_CONSUME_QUEUE && tw->table_key == table_key &&
+				tw->queue_id == queue_id && tw->consumer_id == consumer_id &&
+				tw->shard_id == shard_id && tw->app_id == app_id)
+			{
+				prev_consume_head = tw->new_consume_head;
+				break;
+			}
+		}
+	}
+
+	*new_consume_head = prev_consume_head + max_entries;
+	if(*new_consume_head > no_entries - 1)
+		*new_consume_head = no_entries - 1;
+
+	if(*new_consume_head <= prev_consume_head)
+	{
+		*new_consume_head = prev_consume_head;
+		return DB_ERR_QUEUE_COMPLETE; // Nothing to consume
+	}
+
+	return add_consume_queue_to_txn(consumer_id, shard_id, app_id, table_key, queue_id,
+			*new_consume_head, ts, fastrandstate);
+}
+
 int subscribe_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
 						queue_callback * callback, int64_t * prev_read_head, int64_t * prev_consume_head,
 						uuid_t * txnid, db_t * db, unsigned int * fastrandstate)
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef USE_GC
+
+void *$alloc(size_t size) {
+    return GC_MALLOC(size);
+}
+
+void $free(void *p, size_t size) {
+    GC_FREE(p);
+}
+
+#else
+
+struct $Heap {
+    void *free[$ALLOC_CLASSES];                 // touched by the owner thread only
+    void *remote[$ALLOC_CLASSES];               // pushed to by other threads, taken whole by the owner
+};
+
+// Slabs are $ALLOC_SLAB aligned, so the slab (and owner) of a block is found by masking its address.
+// The header takes up the first grain of the slab.
+struct $Slab {
+    struct $Heap *heap;
+};
+
+static _Thread_local struct $Heap *$heap = NULL;
+
+static void *$alloc_refill(struct $Heap *h, int c) {
+    void *first = __atomic_exchange_n(&h->remote[c], NULL, __ATOMIC_ACQUIRE);
+    if (first)
+        return first;
+    struct $Slab *s = aligned_alloc($ALLOC_SLAB, $ALLOC_SLAB);
+    if (!s)
+        return NULL;
+    s->heap = h;
+    size_t size = (c + 1) * $ALLOC_GRAIN;
+    long n = ($ALLOC_SLAB - $ALLOC_GRAIN) / size;
+    char *base = (char*)s + $ALLOC_GRAIN;
+    for (long i = n - 1; i >= 0; i--) {
+        void **block = (void**)(base + i * size);
+        *block = first;
+        first = block;
+    }
+    return first;
+}
+
+void *$alloc(size_t size) {
+    if (size > $ALLOC_CLASSES * $ALLOC_GRAIN)
+        return malloc(size);
+    int c = size ? (size - 1) / $ALLOC_GRAIN : 0;
+    struct $Heap *h = $heap;
+    if (!h)
+        h = $heap = calloc(1, sizeof(struct $Heap));
+    void *p = h->free[c];
+    if (!p) {
+        p = $alloc_refill(h, c);
+        if (!p)
+            return NULL;
+    }
+    h->free[c] = *(void**)p;
+    return p;
+}
+
+// "size" must be the size the block was allocated with.
+void $free(void *p, size_t size) {
+    if (!p)
+        return;
+    if (size > $ALLOC_CLASSES * $ALLOC_GRAIN) {
+        free(p);
+        return;
+    }
+    int c = size ? (size - 1) / $ALLOC_GRAIN : 0;
+    struct $Heap *h = ((struct $Slab*)((uintptr_t)p & ~(uintptr_t)($ALLOC_SLAB - 1)))->heap;
+    if (h == $heap) {
+        *(void**)p = h->free[c];
+        h->free[c] = p;
+    } else {
+        void *old = __atomic_load_n(&h->remote[c], __ATOMIC_RELAXED);
+        do {
+            *(void**)p = old;
+        } while (!__atomic_compare_exchange_n(&h->remote[c], &old, p, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+}
+
+#endif
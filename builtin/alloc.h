@@ -0,0 +1,26 @@
+// Per-thread allocator for the small, short-lived objects created by $NEW and the RTS
+// (messages, catchers, continuations). Objects of up to $ALLOC_CLASSES*$ALLOC_GRAIN
+// bytes are taken from thread-local free lists, refilled from $ALLOC_SLAB sized slabs;
+// larger objects fall back to malloc. Blocks freed by another thread than the one that
+// allocated them are returned to the owner through a lock-free remote free list.
+//
+// When built with USE_GC, all of builtin, stdlib and the RTS allocate from the heap of the
+// (conservative, mark-sweep) Boehm collector instead, so that the collector sees every
+// pointer to an object. $free is then only a hint. Memory owned by the backend is not
+// affected, and must not hold the only reference to an RTS object.
+
+#ifdef USE_GC
+#define GC_THREADS 1
+#include <gc.h>
+#define malloc(size)        GC_MALLOC(size)
+#define calloc(n, size)     GC_MALLOC((n)*(size))
+#define realloc(p, size)    GC_REALLOC(p, size)
+#define free(p)             GC_FREE(p)
+#endif
+
+#define $ALLOC_GRAIN        16
+#define $ALLOC_CLASSES      16
+#define $ALLOC_SLAB         (64*1024)
+
+void *$alloc(size_t size);
+void $free(void *p, size_t size);
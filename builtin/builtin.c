@@ -20,6 +20,7 @@
 
 #include "builtin.h"
 
+#include "alloc.c"
 #include "common.c"
 #include "__builtin__.c"
 #include "class_hierarchy.c"
@@ -11,7 +11,9 @@
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
 
+#include "alloc.h"
 #include "common.h"
 #include "__builtin__.h"
 #include "serialize.h"
@@ -11,16 +11,16 @@ void $default__init__($WORD);
 void $printobj(char *mess,$WORD obj);
 
 
-#define $NEW($T, ...)       ({ $T $t = malloc(sizeof(struct $T)); \
+#define $NEW($T, ...)       ({ $T $t = $alloc(sizeof(struct $T)); \
                                $t->$class = &$T ## $methods; \
                                $t->$class->__init__($t, ##__VA_ARGS__); \
                                $t; })
 
-#define $NEWCC($X, $c, ...) ({ $X $x = malloc(sizeof(struct $X)); \
+#define $NEWCC($X, $c, ...) ({ $X $x = $alloc(sizeof(struct $X)); \
                                $x->$class = &$X ## $methods; \
                                $x->$class->__init__($x, ##__VA_ARGS__, $CONSTCONT($x,$c)); })
 
-#define $DNEW($T, $state)   ({ $T $t = malloc(sizeof(struct $T)); \
+#define $DNEW($T, $state)   ({ $T $t = $alloc(sizeof(struct $T)); \
                                $t->$class = &$T ## $methods;                                     \
                                $dict_setitem($state->done,($Hashable)$Hashable$int$witness,to$int($state->row_no-1),$t); \
                                $t; })
@@ -16,38 +16,405 @@
 
 struct FileDescriptorData fd_data[MAX_FD];
 int wakeup_pipe[2];
+static bool OUT_ready(int fd);
+
+static void report_closed(int fd) {
+    $str msg = $Times$str$witness->$class->__add__($Times$str$witness,$getName(fd),to$str(" closed connection\n"));
+    if (fd_data[fd].errhandler)
+        fd_data[fd].errhandler->$class->__call__(fd_data[fd].errhandler,msg);
+    else {
+        perror("Remote host closed connection");
+        exit(-1);
+    }
+}
+
+/*
+ * Binary receipt, asked for with Connection.on_receipt_bytes. A read goes into
+ * a buffer of RECV_BYTES held by the eventloop, and only the bytes read are
+ * copied into a new bytearray, which the handler gets to keep. There is no
+ * UTF-8 scan, and NUL bytes are data like any other. An epoll loop has one
+ * buffer for all its descriptors. With io_uring, reads on many descriptors are
+ * outstanding at once, so each descriptor gets a buffer of its own on its first
+ * binary read, and keeps it for later connections on the same descriptor.
+ */
+static void RECV_deliver(int fd, char *buf, int n) {
+    $bytearray b = $alloc(sizeof(struct $bytearray));
+    b->$class = &$bytearray$methods;
+    b->nbytes = b->capacity = n;
+    b->str = malloc(n + 1);                     // not $alloc, as a bytearray grows by realloc
+    memcpy(b->str, buf, n);
+    b->str[n] = 0;
+    fd_data[fd].rhandler->$class->__call__(fd_data[fd].rhandler, b);
+}
+bool rts_io_uring = false;
+long rts_eventloops = 1;
+bool rts_ddb = false;        // set by the RTS when it runs with a DDB backend
+
+#if defined(IS_GNU_LINUX) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <poll.h>
+
+#ifndef IORING_ACCEPT_MULTISHOT
+#define IORING_ACCEPT_MULTISHOT (1U << 0)
+#endif
+
+/*
+ * io_uring, selected with --rts-io-uring. Instead of waiting for readiness and
+ * then doing the read or accept itself, the eventloop keeps a read going on
+ * every descriptor that has a read handler, straight into fd_data[fd].buffer,
+ * and a multishot accept on every listening socket, and acts on their
+ * completions. One io_uring_enter submits the requests of the last turn and
+ * waits for completions or the next timer. fd_data is registered as a fixed
+ * buffer where the memlock limit allows it, so that reads need not map its
+ * pages every time. Requests are made by any thread under uring.lock, those of
+ * other threads than the eventloop are submitted at once. Completions are
+ * only reaped by the eventloop. Without io_uring, or IORING_FEAT_EXT_ARG for
+ * waiting with a timeout, the eventloop stays with epoll.
+ */
+enum { URING_WAKEUP, URING_READ, URING_RECV, URING_ACCEPT, URING_CONNECT, URING_WRITE, URING_CANCEL };
+#define URING_DATA(op, fd)  (((__u64)(op) << 32) | (unsigned)(fd))
+
+static struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned pending;                   // requests of the eventloop not yet submitted
+    bool fixed;                         // fd_data is registered as buffer 0
+    bool multishot;                     // until the kernel says otherwise
+    bool reading[MAX_FD];               // a read is outstanding on the descriptor
+    char *recv[MAX_FD];                 // ... into this, for binary receipt
+    pthread_mutex_t lock;
+} uring = { .fd = -1, .multishot = true };
+
+static _Thread_local bool uring_looping = false;
+static char uring_drain[64];
+
+#define URING_ON    (uring.fd >= 0)
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return syscall(__NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static bool URING_init() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    int fd = syscall(__NR_io_uring_setup, 256, &p);
+    if (fd < 0)
+        return false;
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(fd);
+        return false;
+    }
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t size = sq_size > cq_size ? sq_size : cq_size;
+    char *rings = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    struct io_uring_sqe *sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (rings == MAP_FAILED || sqes == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    uring.sq_head = (unsigned *)(rings + p.sq_off.head);
+    uring.sq_tail = (unsigned *)(rings + p.sq_off.tail);
+    uring.sq_mask = (unsigned *)(rings + p.sq_off.ring_mask);
+    uring.sq_array = (unsigned *)(rings + p.sq_off.array);
+    uring.cq_head = (unsigned *)(rings + p.cq_off.head);
+    uring.cq_tail = (unsigned *)(rings + p.cq_off.tail);
+    uring.cq_mask = (unsigned *)(rings + p.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe *)(rings + p.cq_off.cqes);
+    uring.sq_entries = p.sq_entries;
+    uring.sqes = sqes;
+    struct iovec iov = { fd_data, sizeof fd_data };
+    uring.fixed = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    pthread_mutex_init(&uring.lock, NULL);
+    uring.fd = fd;
+    return true;
+}
+
+// Take a submission queue entry, with uring.lock held.
+static struct io_uring_sqe *uring_sqe() {
+    unsigned tail = *uring.sq_tail;
+    if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) == uring.sq_entries) {
+        uring_enter(uring.pending, 0, 0, NULL, 0);                  // full, make room
+        uring.pending = 0;
+    }
+    unsigned idx = tail & *uring.sq_mask;
+    struct io_uring_sqe *sqe = &uring.sqes[idx];
+    memset(sqe, 0, sizeof *sqe);
+    uring.sq_array[idx] = idx;
+    return sqe;
+}
+
+// Hand the entry taken by uring_sqe to the kernel, with uring.lock held.
+static void uring_push() {
+    __atomic_store_n(uring.sq_tail, *uring.sq_tail + 1, __ATOMIC_RELEASE);
+    uring.pending++;
+    if (!uring_looping) {
+        uring_enter(uring.pending, 0, 0, NULL, 0);
+        uring.pending = 0;
+    }
+}
+
+static void uring_read(int fd, char *buf, unsigned len, int op) {
+    struct io_uring_sqe *sqe = uring_sqe();
+    bool fixed = uring.fixed && op == URING_READ;
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (__u64)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = (__u64)-1;                                           // at the current position, if any
+    sqe->user_data = URING_DATA(op, fd);
+    uring_push();
+}
+
+static void uring_accept(int fd) {
+    struct io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    if (uring.multishot)
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_DATA(URING_ACCEPT, fd);
+    uring_push();
+}
+
+static void URING_add_read(int fd) {
+    pthread_mutex_lock(&uring.lock);
+    if (!uring.reading[fd]) {
+        uring.reading[fd] = true;
+        if (fd_data[fd].binary) {
+            if (!uring.recv[fd])
+                uring.recv[fd] = malloc(RECV_BYTES);
+            uring_read(fd, uring.recv[fd], RECV_BYTES, URING_RECV);
+        } else
+            uring_read(fd, fd_data[fd].buffer, BUF_SIZE - 1, URING_READ);
+    }
+    pthread_mutex_unlock(&uring.lock);
+}
+
+// Only used for listening sockets, which get a (multishot) accept.
+static void URING_add_read_once(int fd) {
+    pthread_mutex_lock(&uring.lock);
+    uring_accept(fd);
+    pthread_mutex_unlock(&uring.lock);
+}
+
+static void uring_poll_out(int fd, int op) {
+    pthread_mutex_lock(&uring.lock);
+    struct io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = URING_DATA(op, fd);
+    uring_push();
+    pthread_mutex_unlock(&uring.lock);
+}
+
+static void URING_add_write_once(int fd) {
+    uring_poll_out(fd, URING_CONNECT);
+}
+
+// Wait for room to write out the output queue of fd. Polls are one-shot, and
+// are made again from the completion while there is output left.
+static void URING_add_write(int fd) {
+    uring_poll_out(fd, URING_WRITE);
+}
+
+static void URING_del_read(int fd) {
+    pthread_mutex_lock(&uring.lock);
+    if (uring.reading[fd]) {
+        struct io_uring_sqe *sqe = uring_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = URING_DATA(fd_data[fd].binary ? URING_RECV : URING_READ, fd);
+        sqe->user_data = URING_DATA(URING_CANCEL, fd);
+        uring_push();
+    }
+    pthread_mutex_unlock(&uring.lock);
+}
+
+static void uring_complete(int op, int fd, int res, unsigned flags) {
+    switch (op) {
+        case URING_WAKEUP:                      // just ends the wait, timers are looked at next turn
+            pthread_mutex_lock(&uring.lock);
+            uring_read(fd, uring_drain, sizeof uring_drain, URING_WAKEUP);
+            pthread_mutex_unlock(&uring.lock);
+            break;
+        case URING_READ:
+            pthread_mutex_lock(&uring.lock);
+            uring.reading[fd] = false;
+            pthread_mutex_unlock(&uring.lock);
+            if (res == -ECANCELED)
+                break;
+            if (res <= 0) {
+                if (res < 0)
+                    fprintf(stderr, "EVENT error: %s\n", strerror(-res));
+                report_closed(fd);
+                break;
+            }
+            fd_data[fd].buffer[res] = 0;
+            fd_data[fd].rhandler->$class->__call__(fd_data[fd].rhandler,to$str(fd_data[fd].buffer));
+            if (fd_data[fd].kind == readhandler)
+                URING_add_read(fd);
+            break;
+        case URING_RECV: {
+            pthread_mutex_lock(&uring.lock);
+            uring.reading[fd] = false;
+            pthread_mutex_unlock(&uring.lock);
+            if (res == -ECANCELED)
+                break;
+            if (res == -EAGAIN || res == -EINTR) {
+                if (fd_data[fd].kind == readhandler)
+                    URING_add_read(fd);
+                break;
+            }
+            if (res <= 0) {
+                if (res < 0)
+                    fprintf(stderr, "EVENT error: %s\n", strerror(-res));
+                report_closed(fd);
+                break;
+            }
+            RECV_deliver(fd, uring.recv[fd], res);
+            if (fd_data[fd].kind == readhandler)
+                URING_add_read(fd);
+            break;
+        }
+        case URING_ACCEPT:
+            if (res >= 0) {
+                int fd2 = res;
+                socklen_t socklen = sizeof(fd_data[fd2].sock_addr);
+                fd_data[fd2].kind = connecthandler;
+                fd_data[fd2].chandler = fd_data[fd].chandler;
+                getpeername(fd2, (struct sockaddr *)&fd_data[fd2].sock_addr, &socklen);
+                bzero(fd_data[fd2].buffer,BUF_SIZE);
+                setupConnection(fd2);
+                printf("%s %s\n","Connection from",$getName(fd2)->str);
+            } else if (res == -EINVAL && uring.multishot) {
+                uring.multishot = false;
+            } else {
+                fprintf(stderr, "EVENT error: %s\n", strerror(-res));
+            }
+            if (!(flags & IORING_CQE_F_MORE))
+                URING_add_read_once(fd);
+            break;
+        case URING_CONNECT:                     // a delayed connection attempt has finished
+            if (res < 0 || (res & (POLLERR | POLLHUP)))
+                fd_data[fd].chandler->$class->__call__(fd_data[fd].chandler, NULL);
+            else
+                setupConnection(fd);
+            break;
+        case URING_WRITE:
+            if (OUT_ready(fd))
+                URING_add_write(fd);
+            break;
+        case URING_CANCEL:
+            break;
+    }
+}
+
+static void *URING_eventloop() {
+    uring_looping = true;
+    pthread_mutex_lock(&uring.lock);
+    uring_read(wakeup_pipe[0], uring_drain, sizeof uring_drain, URING_WAKEUP);
+    pthread_mutex_unlock(&uring.lock);
+    while (1) {
+        struct __kernel_timespec tspec;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof arg);
+
+        WAKE_hold();
+        unsigned head = *uring.cq_head;
+        unsigned tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe cqe = uring.cqes[head & *uring.cq_mask];
+            __atomic_store_n(uring.cq_head, ++head, __ATOMIC_RELEASE);
+            uring_complete(cqe.user_data >> 32, (int)(cqe.user_data & 0xffffffff), cqe.res, cqe.flags);
+        }
+        handle_timeout();
+        WAKE_release();
+
+        time_t next_time = next_timeout();
+        if (next_time) {
+            time_t now = current_time();
+            time_t offset = next_time > now ? next_time - now : 0;
+            tspec.tv_sec = offset / 1000000;
+            tspec.tv_nsec = 1000 * (offset % 1000000);
+            arg.ts = (__u64)(uintptr_t)&tspec;
+        }
+
+        pthread_mutex_lock(&uring.lock);
+        unsigned to_submit = uring.pending;
+        uring.pending = 0;
+        pthread_mutex_unlock(&uring.lock);
+        // Blocking call
+        if (uring_enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg) < 0 &&
+            errno != ETIME && errno != EINTR)
+            fprintf(stderr, "EVENT error: %s\n", strerror(errno));
+    }
+    return NULL;
+}
+
+#else
+#define URING_ON    false
+static inline bool URING_init() { return false; }
+static inline void URING_add_read(int fd) {}
+static inline void URING_add_read_once(int fd) {}
+static inline void URING_add_write_once(int fd) {}
+static inline void URING_add_write(int fd) {}
+static inline void URING_del_read(int fd) {}
+static inline void *URING_eventloop() { return NULL; }
+#endif
+
 
 
 #ifdef IS_MACOS         // Use kqueue
-int kq;
+int *kq;                        // one per eventloop
 void EVENT_init() {
-    kq = kqueue();
+    kq = malloc(rts_eventloops * sizeof(int));
+    for (long loop = 0; loop < rts_eventloops; loop++)
+        kq[loop] = kqueue();
     struct kevent wakeup;
     EV_SET(&wakeup, wakeup_pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
-    kevent(kq, &wakeup, 1, NULL, 0, NULL);
+    kevent(kq[0], &wakeup, 1, NULL, 0, NULL);
 }
 void EVENT_add_read(int fd) {
     EV_SET(&fd_data[fd].event_spec, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
-    kevent(kq, &fd_data[fd].event_spec, 1, NULL, 0, NULL);
+    kevent(kq[fd_data[fd].loop], &fd_data[fd].event_spec, 1, NULL, 0, NULL);
 }
 void EVENT_add_read_once(int fd) {
     EV_SET(&fd_data[fd].event_spec, fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, NULL);
-    kevent(kq, &fd_data[fd].event_spec, 1, NULL, 0, NULL);
+    kevent(kq[fd_data[fd].loop], &fd_data[fd].event_spec, 1, NULL, 0, NULL);
 }
 void EVENT_mod_read_once(int fd) {
     EV_SET(&fd_data[fd].event_spec, fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, NULL);
-    kevent(kq, &fd_data[fd].event_spec, 1, NULL, 0, NULL);
+    kevent(kq[fd_data[fd].loop], &fd_data[fd].event_spec, 1, NULL, 0, NULL);
 }
 void EVENT_add_write_once(int fd) {
     EV_SET(&fd_data[fd].event_spec, fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT, 0, 0, NULL);
-    kevent(kq, &fd_data[fd].event_spec, 1, NULL, 0, NULL);
+    kevent(kq[fd_data[fd].loop], &fd_data[fd].event_spec, 1, NULL, 0, NULL);
 }
 void EVENT_del_read(int fd) {
     EV_SET(&fd_data[fd].event_spec, fd, EVFILT_READ, EV_DISABLE, 0, 0, NULL);
-    kevent(kq, &fd_data[fd].event_spec, 1, NULL, 0, NULL);
+    kevent(kq[fd_data[fd].loop], &fd_data[fd].event_spec, 1, NULL, 0, NULL);
+}
+void EVENT_add_write(int fd) {
+    struct kevent write;
+    EV_SET(&write, fd, EVFILT_WRITE, EV_ADD, 0, 0, NULL);
+    kevent(kq[fd_data[fd].loop], &write, 1, NULL, 0, NULL);
+}
+void EVENT_del_write(int fd) {
+    struct kevent write;
+    EV_SET(&write, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    kevent(kq[fd_data[fd].loop], &write, 1, NULL, 0, NULL);
 }
-int EVENT_wait(EVENT_type *ev, struct timespec *timeout) {
-    return kevent(kq, NULL, 0, ev, 1, timeout);
+int EVENT_wait(long loop, EVENT_type *ev, int n, struct timespec *timeout) {
+    return kevent(kq[loop], NULL, 0, ev, n, timeout);
 }
 int EVENT_fd(EVENT_type *ev) {
     return ev->ident;
@@ -67,49 +434,106 @@ int EVENT_errno(EVENT_type *ev) {
 int EVENT_is_read(EVENT_type *ev) {
     return ev->filter==EVFILT_READ;
 }
+int EVENT_is_write(EVENT_type *ev) {
+    return ev->filter==EVFILT_WRITE;
+}
 int EVENT_fd_is_read(int fd) {
     return fd_data[fd].event_spec.filter == EVFILT_READ;
 }
 #endif
 
 #ifdef IS_GNU_LINUX             // Use epoll            
-int ep;
+int *ep;                        // one per eventloop
 void EVENT_init() {
-    ep = epoll_create(1);
+    if (rts_io_uring) {
+        if (URING_init()) {
+            rts_eventloops = 1;
+            return;
+        }
+        fprintf(stderr, "io_uring is not available, using epoll\n");
+        rts_io_uring = false;
+    }
+    ep = malloc(rts_eventloops * sizeof(int));
+    for (long loop = 0; loop < rts_eventloops; loop++)
+        ep[loop] = epoll_create(1);
     struct epoll_event wakeup;
     wakeup.events = EPOLLIN;
     wakeup.data.fd = wakeup_pipe[0];
-    epoll_ctl(ep, EPOLL_CTL_ADD, wakeup_pipe[0], &wakeup);
+    epoll_ctl(ep[0], EPOLL_CTL_ADD, wakeup_pipe[0], &wakeup);
 }
 void EVENT_add_read(int fd) {
+    if (URING_ON) {
+        URING_add_read(fd);
+        return;
+    }
     fd_data[fd].event_spec.events = EPOLLIN;
     fd_data[fd].event_spec.data.fd = fd;
-    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &fd_data[fd].event_spec);
+    if (epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_ADD, fd, &fd_data[fd].event_spec) < 0 && errno == EEXIST) {
+        struct epoll_event both = fd_data[fd].event_spec;     // already there for writing
+        if (fd_data[fd].out_armed)
+            both.events |= EPOLLOUT;
+        epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_MOD, fd, &both);
+    }
 }
 void EVENT_add_read_once(int fd) {
+    if (URING_ON) {
+        URING_add_read_once(fd);
+        return;
+    }
     fd_data[fd].event_spec.events = EPOLLIN | EPOLLONESHOT;
     fd_data[fd].event_spec.data.fd = fd;
-    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &fd_data[fd].event_spec);
+    epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_ADD, fd, &fd_data[fd].event_spec);
 }
 void EVENT_mod_read_once(int fd) {
     fd_data[fd].event_spec.events = EPOLLIN | EPOLLONESHOT;
     fd_data[fd].event_spec.data.fd = fd;
-    epoll_ctl(ep, EPOLL_CTL_MOD, fd, &fd_data[fd].event_spec);
+    epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_MOD, fd, &fd_data[fd].event_spec);
 }
 void EVENT_add_write_once(int fd) {
+    if (URING_ON) {
+        URING_add_write_once(fd);
+        return;
+    }
     fd_data[fd].event_spec.events = EPOLLOUT | EPOLLONESHOT;
     fd_data[fd].event_spec.data.fd = fd;
-    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &fd_data[fd].event_spec);
+    epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_ADD, fd, &fd_data[fd].event_spec);
 }
 void EVENT_del_read(int fd) {
+    if (URING_ON) {
+        URING_del_read(fd);
+        return;
+    }
     fd_data[fd].event_spec.events = EPOLLIN;
     fd_data[fd].event_spec.data.fd = fd;
-    epoll_ctl(ep, EPOLL_CTL_DEL, fd, &fd_data[fd].event_spec);
+    epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_DEL, fd, &fd_data[fd].event_spec);
+}
+// Writing is waited for on the side of any reading, so event_spec is left
+// alone and the registration of fd is changed to cover both.
+static void epoll_set_write(int fd, bool write) {
+    struct epoll_event both;
+    both.events = (fd_data[fd].kind == readhandler ? EPOLLIN : 0) | (write ? EPOLLOUT : 0);
+    both.data.fd = fd;
+    if (!both.events)                   // else hangups would still be reported
+        epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_DEL, fd, &both);
+    else if (epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_MOD, fd, &both) < 0 && errno == ENOENT)
+        epoll_ctl(ep[fd_data[fd].loop], EPOLL_CTL_ADD, fd, &both);
+}
+void EVENT_add_write(int fd) {
+    if (URING_ON) {
+        URING_add_write(fd);
+        return;
+    }
+    epoll_set_write(fd, true);
+}
+void EVENT_del_write(int fd) {
+    if (URING_ON)
+        return;
+    epoll_set_write(fd, false);
 }
-int EVENT_wait(EVENT_type *ev, struct timespec *timeout) {
-    int msec = timeout ? timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000 : -1;
-    return epoll_wait(ep, ev, 1, msec);
-//    return epoll_pwait2(ep, ev, 1, timeout, NULL);        // appears in linux kernel 5.11
+int EVENT_wait(long loop, EVENT_type *ev, int n, struct timespec *timeout) {
+    int msec = timeout ? timeout->tv_sec * 1000 + (timeout->tv_nsec + 999999) / 1000000 : -1;   // round up, waking early only spins
+    return epoll_wait(ep[loop], ev, n, msec);
+//    return epoll_pwait2(ep[loop], ev, n, timeout, NULL);        // appears in linux kernel 5.11
 }
 int EVENT_fd(EVENT_type *ev) {
     return ev->data.fd;
@@ -132,6 +556,9 @@ int EVENT_errno(EVENT_type *ev) {
 int EVENT_is_read(EVENT_type *ev) {
     return ev->events & EPOLLIN;
 }
+int EVENT_is_write(EVENT_type *ev) {
+    return ev->events & EPOLLOUT;
+}
 int EVENT_fd_is_read(int fd) {
     return fd_data[fd].event_spec.events & EPOLLIN;
 }
@@ -140,13 +567,125 @@ int EVENT_fd_is_read(int fd) {
 static void $init_FileDescriptorData(int fd) {
   fd_data[fd].kind = nohandler;
   bzero(fd_data[fd].buffer,BUF_SIZE);
+  fd_data[fd].out_head = fd_data[fd].out_tail = NULL;
+  fd_data[fd].out_len = 0;
+  fd_data[fd].out_armed = fd_data[fd].out_closing = false;
+  fd_data[fd].out_waiting = NULL;
+}
+
+/*
+ * Output queues. Connection.write appends its string to the output queue of
+ * the descriptor, and writes out what the socket takes of the queue with one
+ * sendmsg, a writev that does not raise SIGPIPE. The rest is written out by
+ * the eventloop as the socket becomes writable. While more than OUTQ_HIGH
+ * bytes are queued, the write does not complete: the Connection waits, as for
+ * a blocking call, until the eventloop has brought the queue down to
+ * OUTQ_LOW, and so does anyone awaiting the write. Messages to the Connection
+ * meanwhile pile up in its mailbox, which holds back their senders if the
+ * mailbox capacity is bounded. A close waits for the queue to drain. With a
+ * DDB the write never waits, as the message it waits on is not persisted and
+ * the wait would be lost in a restart; the queue is then unbounded.
+ */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#define OUT_IOV 64
+
+static void OUT_drop(struct FileDescriptorData *d) {
+    while (d->out_head) {
+        struct $OutChunk *c = d->out_head;
+        d->out_head = c->next;
+        $free(c, sizeof(struct $OutChunk));
+    }
+    d->out_tail = NULL;
+    d->out_len = 0;
+}
+
+// Write out as much of the queue of fd as the socket takes, with out_lock
+// held. On an error, the queue is dropped; a hangup reaches the errhandler
+// through the eventloop.
+static void OUT_flush(int fd) {
+    struct FileDescriptorData *d = &fd_data[fd];
+    while (d->out_head) {
+        struct iovec iov[OUT_IOV];
+        int n = 0;
+        size_t total = 0;
+        for (struct $OutChunk *c = d->out_head; c && n < OUT_IOV; c = c->next, n++) {
+            iov[n].iov_base = c->str->str + c->off;
+            iov[n].iov_len = c->str->nbytes - c->off;
+            total += iov[n].iov_len;
+        }
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = n };
+        ssize_t r = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                OUT_drop(d);
+            return;
+        }
+        d->out_len -= r;
+        for (size_t done = r; done > 0; ) {
+            struct $OutChunk *c = d->out_head;
+            size_t left = c->str->nbytes - c->off;
+            if (done < left) {
+                c->off += done;
+                break;
+            }
+            done -= left;
+            d->out_head = c->next;
+            $free(c, sizeof(struct $OutChunk));
+        }
+        if (!d->out_head)
+            d->out_tail = NULL;
+        if (r < total)                  // the socket is full
+            return;
+    }
+}
+
+static void close_descriptor(int fd) {
+    EVENT_del_read(fd);
+    close(fd);
+    $init_FileDescriptorData(fd);
+}
+
+// Called by the eventloop when fd has room for more output. Returns true if
+// output is left, for which the caller has to wait again if its readiness is
+// one-shot.
+static bool OUT_ready(int fd) {
+    struct FileDescriptorData *d = &fd_data[fd];
+    pthread_mutex_lock(&d->out_lock);
+    if (!d->out_armed) {
+        pthread_mutex_unlock(&d->out_lock);
+        return false;
+    }
+    OUT_flush(fd);
+    $Msg waiting = NULL;
+    if (d->out_len <= OUTQ_LOW) {
+        waiting = d->out_waiting;
+        d->out_waiting = NULL;
+    }
+    bool left = d->out_head != NULL, closing = false;
+    if (!left) {
+        d->out_armed = false;
+        EVENT_del_write(fd);
+        closing = d->out_closing;
+    }
+    pthread_mutex_unlock(&d->out_lock);
+    if (waiting)
+        WAKE_waiting(waiting, $None);
+    if (closing)
+        close_descriptor(fd);
+    return left;
 }
 
 int new_socket ($function handler) {
+  static _Atomic long next_loop = 0;
   int fd = socket(PF_INET,SOCK_STREAM,0);
   fcntl(fd,F_SETFL,O_NONBLOCK);
   fd_data[fd].kind = connecthandler;
   fd_data[fd].chandler = handler;
+  fd_data[fd].loop = next_loop++ % rts_eventloops;
   return fd;
 }
 
@@ -182,7 +721,7 @@ void minienv$$l$1lambda$__serialize__ (minienv$$l$1lambda self, $Serial$state st
 minienv$$l$1lambda minienv$$l$1lambda$__deserialize__ (minienv$$l$1lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$1lambda));
+            self = $alloc(sizeof(struct minienv$$l$1lambda));
             self->$class = &minienv$$l$1lambda$methods;
             return self;
         }
@@ -193,7 +732,7 @@ minienv$$l$1lambda minienv$$l$1lambda$__deserialize__ (minienv$$l$1lambda self,
     return self;
 }
 minienv$$l$1lambda minienv$$l$1lambda$new($Env p$1, $str p$2) {
-    minienv$$l$1lambda $tmp = malloc(sizeof(struct minienv$$l$1lambda));
+    minienv$$l$1lambda $tmp = $alloc(sizeof(struct minienv$$l$1lambda));
     $tmp->$class = &minienv$$l$1lambda$methods;
     minienv$$l$1lambda$methods.__init__($tmp, p$1, p$2);
     return $tmp;
@@ -216,7 +755,7 @@ void minienv$$l$2lambda$__serialize__ (minienv$$l$2lambda self, $Serial$state st
 minienv$$l$2lambda minienv$$l$2lambda$__deserialize__ (minienv$$l$2lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$2lambda));
+            self = $alloc(sizeof(struct minienv$$l$2lambda));
             self->$class = &minienv$$l$2lambda$methods;
             return self;
         }
@@ -227,7 +766,7 @@ minienv$$l$2lambda minienv$$l$2lambda$__deserialize__ (minienv$$l$2lambda self,
     return self;
 }
 minienv$$l$2lambda minienv$$l$2lambda$new($Env p$1, $function p$2) {
-    minienv$$l$2lambda $tmp = malloc(sizeof(struct minienv$$l$2lambda));
+    minienv$$l$2lambda $tmp = $alloc(sizeof(struct minienv$$l$2lambda));
     $tmp->$class = &minienv$$l$2lambda$methods;
     minienv$$l$2lambda$methods.__init__($tmp, p$1, p$2);
     return $tmp;
@@ -256,7 +795,7 @@ void minienv$$l$3lambda$__serialize__ (minienv$$l$3lambda self, $Serial$state st
 minienv$$l$3lambda minienv$$l$3lambda$__deserialize__ (minienv$$l$3lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$3lambda));
+            self = $alloc(sizeof(struct minienv$$l$3lambda));
             self->$class = &minienv$$l$3lambda$methods;
             return self;
         }
@@ -269,7 +808,7 @@ minienv$$l$3lambda minienv$$l$3lambda$__deserialize__ (minienv$$l$3lambda self,
     return self;
 }
 minienv$$l$3lambda minienv$$l$3lambda$new($Env p$1, $str p$2, $int p$3, $function p$4) {
-    minienv$$l$3lambda $tmp = malloc(sizeof(struct minienv$$l$3lambda));
+    minienv$$l$3lambda $tmp = $alloc(sizeof(struct minienv$$l$3lambda));
     $tmp->$class = &minienv$$l$3lambda$methods;
     minienv$$l$3lambda$methods.__init__($tmp, p$1, p$2, p$3, p$4);
     return $tmp;
@@ -295,7 +834,7 @@ void minienv$$l$4lambda$__serialize__ (minienv$$l$4lambda self, $Serial$state st
 minienv$$l$4lambda minienv$$l$4lambda$__deserialize__ (minienv$$l$4lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$4lambda));
+            self = $alloc(sizeof(struct minienv$$l$4lambda));
             self->$class = &minienv$$l$4lambda$methods;
             return self;
         }
@@ -307,7 +846,7 @@ minienv$$l$4lambda minienv$$l$4lambda$__deserialize__ (minienv$$l$4lambda self,
     return self;
 }
 minienv$$l$4lambda minienv$$l$4lambda$new($Env p$1, $int p$2, $function p$3) {
-    minienv$$l$4lambda $tmp = malloc(sizeof(struct minienv$$l$4lambda));
+    minienv$$l$4lambda $tmp = $alloc(sizeof(struct minienv$$l$4lambda));
     $tmp->$class = &minienv$$l$4lambda$methods;
     minienv$$l$4lambda$methods.__init__($tmp, p$1, p$2, p$3);
     return $tmp;
@@ -330,7 +869,7 @@ void minienv$$l$5lambda$__serialize__ (minienv$$l$5lambda self, $Serial$state st
 minienv$$l$5lambda minienv$$l$5lambda$__deserialize__ (minienv$$l$5lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$5lambda));
+            self = $alloc(sizeof(struct minienv$$l$5lambda));
             self->$class = &minienv$$l$5lambda$methods;
             return self;
         }
@@ -341,7 +880,7 @@ minienv$$l$5lambda minienv$$l$5lambda$__deserialize__ (minienv$$l$5lambda self,
     return self;
 }
 minienv$$l$5lambda minienv$$l$5lambda$new($Env p$1, $int p$2) {
-    minienv$$l$5lambda $tmp = malloc(sizeof(struct minienv$$l$5lambda));
+    minienv$$l$5lambda $tmp = $alloc(sizeof(struct minienv$$l$5lambda));
     $tmp->$class = &minienv$$l$5lambda$methods;
     minienv$$l$5lambda$methods.__init__($tmp, p$1, p$2);
     return $tmp;
@@ -364,7 +903,7 @@ void minienv$$l$6lambda$__serialize__ (minienv$$l$6lambda self, $Serial$state st
 minienv$$l$6lambda minienv$$l$6lambda$__deserialize__ (minienv$$l$6lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$6lambda));
+            self = $alloc(sizeof(struct minienv$$l$6lambda));
             self->$class = &minienv$$l$6lambda$methods;
             return self;
         }
@@ -375,7 +914,7 @@ minienv$$l$6lambda minienv$$l$6lambda$__deserialize__ (minienv$$l$6lambda self,
     return self;
 }
 minienv$$l$6lambda minienv$$l$6lambda$new($Env p$1, $str p$2) {
-    minienv$$l$6lambda $tmp = malloc(sizeof(struct minienv$$l$6lambda));
+    minienv$$l$6lambda $tmp = $alloc(sizeof(struct minienv$$l$6lambda));
     $tmp->$class = &minienv$$l$6lambda$methods;
     minienv$$l$6lambda$methods.__init__($tmp, p$1, p$2);
     return $tmp;
@@ -398,7 +937,7 @@ void minienv$$l$7lambda$__serialize__ (minienv$$l$7lambda self, $Serial$state st
 minienv$$l$7lambda minienv$$l$7lambda$__deserialize__ (minienv$$l$7lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$7lambda));
+            self = $alloc(sizeof(struct minienv$$l$7lambda));
             self->$class = &minienv$$l$7lambda$methods;
             return self;
         }
@@ -409,7 +948,7 @@ minienv$$l$7lambda minienv$$l$7lambda$__deserialize__ (minienv$$l$7lambda self,
     return self;
 }
 minienv$$l$7lambda minienv$$l$7lambda$new($Env p$1, $str p$2) {
-    minienv$$l$7lambda $tmp = malloc(sizeof(struct minienv$$l$7lambda));
+    minienv$$l$7lambda $tmp = $alloc(sizeof(struct minienv$$l$7lambda));
     $tmp->$class = &minienv$$l$7lambda$methods;
     minienv$$l$7lambda$methods.__init__($tmp, p$1, p$2);
     return $tmp;
@@ -432,7 +971,7 @@ void minienv$$l$8lambda$__serialize__ (minienv$$l$8lambda self, $Serial$state st
 minienv$$l$8lambda minienv$$l$8lambda$__deserialize__ (minienv$$l$8lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$8lambda));
+            self = $alloc(sizeof(struct minienv$$l$8lambda));
             self->$class = &minienv$$l$8lambda$methods;
             return self;
         }
@@ -443,7 +982,7 @@ minienv$$l$8lambda minienv$$l$8lambda$__deserialize__ (minienv$$l$8lambda self,
     return self;
 }
 minienv$$l$8lambda minienv$$l$8lambda$new($Connection p$1, $str p$2) {
-    minienv$$l$8lambda $tmp = malloc(sizeof(struct minienv$$l$8lambda));
+    minienv$$l$8lambda $tmp = $alloc(sizeof(struct minienv$$l$8lambda));
     $tmp->$class = &minienv$$l$8lambda$methods;
     minienv$$l$8lambda$methods.__init__($tmp, p$1, p$2);
     return $tmp;
@@ -463,7 +1002,7 @@ void minienv$$l$9lambda$__serialize__ (minienv$$l$9lambda self, $Serial$state st
 minienv$$l$9lambda minienv$$l$9lambda$__deserialize__ (minienv$$l$9lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$9lambda));
+            self = $alloc(sizeof(struct minienv$$l$9lambda));
             self->$class = &minienv$$l$9lambda$methods;
             return self;
         }
@@ -473,7 +1012,7 @@ minienv$$l$9lambda minienv$$l$9lambda$__deserialize__ (minienv$$l$9lambda self,
     return self;
 }
 minienv$$l$9lambda minienv$$l$9lambda$new($Connection p$1) {
-    minienv$$l$9lambda $tmp = malloc(sizeof(struct minienv$$l$9lambda));
+    minienv$$l$9lambda $tmp = $alloc(sizeof(struct minienv$$l$9lambda));
     $tmp->$class = &minienv$$l$9lambda$methods;
     minienv$$l$9lambda$methods.__init__($tmp, p$1);
     return $tmp;
@@ -499,7 +1038,7 @@ void minienv$$l$10lambda$__serialize__ (minienv$$l$10lambda self, $Serial$state
 minienv$$l$10lambda minienv$$l$10lambda$__deserialize__ (minienv$$l$10lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$10lambda));
+            self = $alloc(sizeof(struct minienv$$l$10lambda));
             self->$class = &minienv$$l$10lambda$methods;
             return self;
         }
@@ -511,7 +1050,7 @@ minienv$$l$10lambda minienv$$l$10lambda$__deserialize__ (minienv$$l$10lambda sel
     return self;
 }
 minienv$$l$10lambda minienv$$l$10lambda$new($Connection p$1, $function p$2, $function p$3) {
-    minienv$$l$10lambda $tmp = malloc(sizeof(struct minienv$$l$10lambda));
+    minienv$$l$10lambda $tmp = $alloc(sizeof(struct minienv$$l$10lambda));
     $tmp->$class = &minienv$$l$10lambda$methods;
     minienv$$l$10lambda$methods.__init__($tmp, p$1, p$2, p$3);
     return $tmp;
@@ -531,7 +1070,7 @@ void minienv$$l$11lambda$__serialize__ (minienv$$l$11lambda self, $Serial$state
 minienv$$l$11lambda minienv$$l$11lambda$__deserialize__ (minienv$$l$11lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$11lambda));
+            self = $alloc(sizeof(struct minienv$$l$11lambda));
             self->$class = &minienv$$l$11lambda$methods;
             return self;
         }
@@ -541,7 +1080,7 @@ minienv$$l$11lambda minienv$$l$11lambda$__deserialize__ (minienv$$l$11lambda sel
     return self;
 }
 minienv$$l$11lambda minienv$$l$11lambda$new($RFile p$1) {
-    minienv$$l$11lambda $tmp = malloc(sizeof(struct minienv$$l$11lambda));
+    minienv$$l$11lambda $tmp = $alloc(sizeof(struct minienv$$l$11lambda));
     $tmp->$class = &minienv$$l$11lambda$methods;
     minienv$$l$11lambda$methods.__init__($tmp, p$1);
     return $tmp;
@@ -561,7 +1100,7 @@ void minienv$$l$12lambda$__serialize__ (minienv$$l$12lambda self, $Serial$state
 minienv$$l$12lambda minienv$$l$12lambda$__deserialize__ (minienv$$l$12lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$12lambda));
+            self = $alloc(sizeof(struct minienv$$l$12lambda));
             self->$class = &minienv$$l$12lambda$methods;
             return self;
         }
@@ -571,7 +1110,7 @@ minienv$$l$12lambda minienv$$l$12lambda$__deserialize__ (minienv$$l$12lambda sel
     return self;
 }
 minienv$$l$12lambda minienv$$l$12lambda$new($RFile p$1) {
-    minienv$$l$12lambda $tmp = malloc(sizeof(struct minienv$$l$12lambda));
+    minienv$$l$12lambda $tmp = $alloc(sizeof(struct minienv$$l$12lambda));
     $tmp->$class = &minienv$$l$12lambda$methods;
     minienv$$l$12lambda$methods.__init__($tmp, p$1);
     return $tmp;
@@ -594,7 +1133,7 @@ void minienv$$l$13lambda$__serialize__ (minienv$$l$13lambda self, $Serial$state
 minienv$$l$13lambda minienv$$l$13lambda$__deserialize__ (minienv$$l$13lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$13lambda));
+            self = $alloc(sizeof(struct minienv$$l$13lambda));
             self->$class = &minienv$$l$13lambda$methods;
             return self;
         }
@@ -605,7 +1144,7 @@ minienv$$l$13lambda minienv$$l$13lambda$__deserialize__ (minienv$$l$13lambda sel
     return self;
 }
 minienv$$l$13lambda minienv$$l$13lambda$new($WFile p$1, $str p$2) {
-    minienv$$l$13lambda $tmp = malloc(sizeof(struct minienv$$l$13lambda));
+    minienv$$l$13lambda $tmp = $alloc(sizeof(struct minienv$$l$13lambda));
     $tmp->$class = &minienv$$l$13lambda$methods;
     minienv$$l$13lambda$methods.__init__($tmp, p$1, p$2);
     return $tmp;
@@ -625,7 +1164,7 @@ void minienv$$l$14lambda$__serialize__ (minienv$$l$14lambda self, $Serial$state
 minienv$$l$14lambda minienv$$l$14lambda$__deserialize__ (minienv$$l$14lambda self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct minienv$$l$14lambda));
+            self = $alloc(sizeof(struct minienv$$l$14lambda));
             self->$class = &minienv$$l$14lambda$methods;
             return self;
         }
@@ -635,12 +1174,50 @@ minienv$$l$14lambda minienv$$l$14lambda$__deserialize__ (minienv$$l$14lambda sel
     return self;
 }
 minienv$$l$14lambda minienv$$l$14lambda$new($WFile p$1) {
-    minienv$$l$14lambda $tmp = malloc(sizeof(struct minienv$$l$14lambda));
+    minienv$$l$14lambda $tmp = $alloc(sizeof(struct minienv$$l$14lambda));
     $tmp->$class = &minienv$$l$14lambda$methods;
     minienv$$l$14lambda$methods.__init__($tmp, p$1);
     return $tmp;
 }
 struct minienv$$l$14lambda$class minienv$$l$14lambda$methods;
+$NoneType minienv$$l$15lambda$__init__ (minienv$$l$15lambda p$self, $Connection __self__, $function cb1, $function cb2) {
+    p$self->__self__ = __self__;
+    p$self->cb1 = cb1;
+    p$self->cb2 = cb2;
+    return $None;
+}
+$R minienv$$l$15lambda$__call__ (minienv$$l$15lambda p$self, $Cont c$cont) {
+    $Connection __self__ = p$self->__self__;
+    $function cb1 = p$self->cb1;
+    $function cb2 = p$self->cb2;
+    return __self__->$class->on_receipt_bytes$local(__self__, cb1, cb2, c$cont);
+}
+void minienv$$l$15lambda$__serialize__ (minienv$$l$15lambda self, $Serial$state state) {
+    $step_serialize(self->__self__, state);
+    $step_serialize(self->cb1, state);
+    $step_serialize(self->cb2, state);
+}
+minienv$$l$15lambda minienv$$l$15lambda$__deserialize__ (minienv$$l$15lambda self, $Serial$state state) {
+    if (!self) {
+        if (!state) {
+            self = $alloc(sizeof(struct minienv$$l$15lambda));
+            self->$class = &minienv$$l$15lambda$methods;
+            return self;
+        }
+        self = $DNEW(minienv$$l$15lambda, state);
+    }
+    self->__self__ = $step_deserialize(state);
+    self->cb1 = $step_deserialize(state);
+    self->cb2 = $step_deserialize(state);
+    return self;
+}
+minienv$$l$15lambda minienv$$l$15lambda$new($Connection p$1, $function p$2, $function p$3) {
+    minienv$$l$15lambda $tmp = $alloc(sizeof(struct minienv$$l$15lambda));
+    $tmp->$class = &minienv$$l$15lambda$methods;
+    minienv$$l$15lambda$methods.__init__($tmp, p$1, p$2, p$3);
+    return $tmp;
+}
+struct minienv$$l$15lambda$class minienv$$l$15lambda$methods;
 $NoneType $Env$__init__ ($Env __self__, $list argv) {
     $Actor$methods.__init__((($Actor)__self__));
     __self__->argv = argv;
@@ -656,23 +1233,27 @@ $R $Env$stdin_install$local ($Env __self__, $function cb, $Cont c$cont) {
     EVENT_add_read(STDIN_FILENO);
     return $R_CONT(c$cont, $None);
 }
-$R $Env$connect$local ($Env __self__, $str host, $int port, $function cb, $Cont c$cont) {
-    struct sockaddr_in addr;
-    struct in_addr iaddr;
-    struct hostent *ent;
-    int hostid;
-    int fd = new_socket(cb);
-    ent = gethostbyname((char *)host->str); //this should be replaced by calling getaddrinfo
-    if(ent==NULL) {
+struct $connect_call {
+    int fd;
+    $str host;
+};
+// Name lookup and connect, run by the blocking pool.
+$WORD $Env$connect$blocking ($WORD arg) {
+    struct $connect_call *call = arg;
+    int fd = call->fd;
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo((char *)call->host->str, NULL, &hints, &res);
+    $free(call, sizeof(struct $connect_call));
+    if(err) {
       fd_data[fd].chandler->$class->__call__(fd_data[fd].chandler, NULL);
       //fprintf(stderr,"Name lookup error"); 
     }
     else {
-      memcpy(&hostid, ent->h_addr_list[0], sizeof hostid);
-      iaddr.s_addr = hostid;
-      fd_data[fd].sock_addr.sin_addr = iaddr;
-      fd_data[fd].sock_addr.sin_port = htons(port->val);
-      fd_data[fd].sock_addr.sin_family = AF_INET;
+      fd_data[fd].sock_addr.sin_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+      freeaddrinfo(res);
       if (connect(fd,(struct sockaddr *)&fd_data[fd].sock_addr,sizeof(struct sockaddr)) < 0) { // couldn't connect immediately, 
         if (errno==EINPROGRESS)  {                                                             // so check if attempt continues asynchronously.
           EVENT_add_write_once(fd);
@@ -683,18 +1264,44 @@ $R $Env$connect$local ($Env __self__, $str host, $int port, $function cb, $Cont
       } else // connect succeeded immediately (can this ever happen for a non-blocking socket?)
         setupConnection(fd);
     }
-    return $R_CONT(c$cont, $None);
+    return $None;
 }
+$R $Env$connect$local ($Env __self__, $str host, $int port, $function cb, $Cont c$cont) {
+    int fd = new_socket(cb);
+    fd_data[fd].sock_addr.sin_port = htons(port->val);
+    fd_data[fd].sock_addr.sin_family = AF_INET;
+    struct $connect_call *call = $alloc(sizeof(struct $connect_call));
+    call->fd = fd;
+    call->host = host;
+    return $BLOCKING($Env$connect$blocking, call, c$cont);
+}
+// With more than one eventloop, every loop gets a listening socket of its own
+// on the port, and the kernel spreads incoming connections over them.
 $R $Env$listen$local ($Env __self__, $int port, $function cb, $Cont c$cont) {
     struct sockaddr_in addr;
-    int fd = new_socket(cb);
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(port->val);
     addr.sin_family = AF_INET;
-    if (bind(fd,(struct sockaddr *)&addr,sizeof(struct sockaddr)) < 0)
-      fd_data[fd].chandler->$class->__call__(fd_data[fd].chandler, NULL);
-    listen(fd,5);
-    EVENT_add_read_once(fd);
+    int fds[rts_eventloops];
+    for (long loop = 0; loop < rts_eventloops; loop++) {
+      int fd = new_socket(cb);
+      fd_data[fd].loop = loop;
+      if (rts_eventloops > 1) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one);
+      }
+      if (bind(fd,(struct sockaddr *)&addr,sizeof(struct sockaddr)) < 0 || listen(fd,5) < 0) {
+        fd_data[fd].chandler->$class->__call__(fd_data[fd].chandler, NULL);
+        close(fd);
+        $init_FileDescriptorData(fd);
+        // Take down the listeners of the loops before, so that none is left listening
+        while (loop-- > 0)
+            close_descriptor(fds[loop]);
+        break;
+      }
+      EVENT_add_read_once(fd);
+      fds[loop] = fd;
+    }
     return $R_CONT(c$cont, $None);
 }
 $R $Env$exit$local ($Env __self__, $int n, $Cont c$cont) {
@@ -743,7 +1350,7 @@ void $Env$__serialize__ ($Env self, $Serial$state state) {
 $Env $Env$__deserialize__ ($Env self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct $Env));
+            self = $alloc(sizeof(struct $Env));
             self->$class = &$Env$methods;
             return self;
         }
@@ -754,7 +1361,7 @@ $Env $Env$__deserialize__ ($Env self, $Serial$state state) {
     return self;
 }
 $R $Env$new($list p$1, $Cont p$2) {
-    $Env $tmp = malloc(sizeof(struct $Env));
+    $Env $tmp = $alloc(sizeof(struct $Env));
     $tmp->$class = &$Env$methods;
     $Env$methods.__init__($tmp, p$1);
     return $R_CONT(p$2, $tmp);
@@ -763,22 +1370,72 @@ struct $Env$class $Env$methods;
 $NoneType $Connection$__init__ ($Connection __self__, int descr) {
     $Actor$methods.__init__((($Actor)__self__));
     __self__->descriptor = descr;
+    __self__->closed = false;
     return $None;
 }
 $R $Connection$write$local ($Connection __self__, $str s, $Cont c$cont) {
-    memcpy(fd_data[__self__->descriptor].buffer,s->str,s->nbytes+1);
-    int chunk_size = s->nbytes > BUF_SIZE ? BUF_SIZE : s->nbytes; 
-    int r = write(__self__->descriptor,fd_data[__self__->descriptor].buffer,chunk_size);
-    //  for now, assume str->nbytes < BUF_SIZE
+    int fd = __self__->descriptor;
+    struct FileDescriptorData *d = &fd_data[fd];
+    if (__self__->closed || s->nbytes == 0)         // written after close
+        return $R_CONT(c$cont, $None);
+    struct $OutChunk *c = $alloc(sizeof(struct $OutChunk));
+    c->next = NULL;
+    c->str = s;
+    c->off = 0;
+    $Msg wait = NULL;
+    pthread_mutex_lock(&d->out_lock);
+    if (d->out_tail)
+        d->out_tail->next = c;
+    else
+        d->out_head = c;
+    d->out_tail = c;
+    d->out_len += s->nbytes;
+    if (!d->out_armed) {                    // else the eventloop writes it out, in order
+        OUT_flush(fd);
+        if (d->out_head) {
+            d->out_armed = true;
+            EVENT_add_write(fd);
+        }
+    }
+    if (d->out_len > OUTQ_HIGH && !rts_ddb) {
+        wait = $NEW($Msg, NULL, c$cont, 0, NULL);       // a non-NULL $cont keeps it open for waiters
+        d->out_waiting = wait;
+    }
+    pthread_mutex_unlock(&d->out_lock);
+    if (wait)
+        return $R_WAIT(c$cont, wait);
     return $R_CONT(c$cont, $None);
 }
 $R $Connection$close$local ($Connection __self__, $Cont c$cont) {
-    close(__self__->descriptor); 
-    $init_FileDescriptorData(__self__->descriptor);
+    int fd = __self__->descriptor;
+    struct FileDescriptorData *d = &fd_data[fd];
+    if (__self__->closed)
+        return $R_CONT(c$cont, $None);
+    __self__->closed = true;
+    pthread_mutex_lock(&d->out_lock);
+    bool pending = d->out_head != NULL;
+    if (pending)
+        d->out_closing = true;              // closed by the eventloop once written out
+    pthread_mutex_unlock(&d->out_lock);
+    if (!pending)
+        close_descriptor(fd);
     return $R_CONT(c$cont, $None);
 }
 $R $Connection$on_receipt$local ($Connection __self__, $function cb1, $function cb2, $Cont c$cont) {
+    if (__self__->closed)
+        return $R_CONT(c$cont, $None);
+    fd_data[__self__->descriptor].kind = readhandler;
+    fd_data[__self__->descriptor].binary = false;
+    fd_data[__self__->descriptor].rhandler = cb1;
+    fd_data[__self__->descriptor].errhandler = cb2;
+    EVENT_add_read(__self__->descriptor);
+    return $R_CONT(c$cont, $None);
+}
+$R $Connection$on_receipt_bytes$local ($Connection __self__, $function cb1, $function cb2, $Cont c$cont) {
+    if (__self__->closed)
+        return $R_CONT(c$cont, $None);
     fd_data[__self__->descriptor].kind = readhandler;
+    fd_data[__self__->descriptor].binary = true;
     fd_data[__self__->descriptor].rhandler = cb1;
     fd_data[__self__->descriptor].errhandler = cb2;
     EVENT_add_read(__self__->descriptor);
@@ -793,13 +1450,16 @@ $Msg $Connection$close ($Connection __self__) {
 $Msg $Connection$on_receipt ($Connection __self__, $function cb1, $function cb2) {
     return $ASYNC((($Actor)__self__), (($Cont)minienv$$l$10lambda$new(__self__, cb1, cb2)));
 }
+$Msg $Connection$on_receipt_bytes ($Connection __self__, $function cb1, $function cb2) {
+    return $ASYNC((($Actor)__self__), (($Cont)minienv$$l$15lambda$new(__self__, cb1, cb2)));
+}
 void $Connection$__serialize__ ($Connection self, $Serial$state state) {
     $Actor$methods.__serialize__(($Actor)self, state);
 }
 $Connection $Connection$__deserialize__ ($Connection self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct $Connection));
+            self = $alloc(sizeof(struct $Connection));
             self->$class = &$Connection$methods;
             return self;
         }
@@ -809,7 +1469,7 @@ $Connection $Connection$__deserialize__ ($Connection self, $Serial$state state)
     return self;
 }
 $R $Connection$new(int descr, $Cont p$1) {
-    $Connection $tmp = malloc(sizeof(struct $Connection));
+    $Connection $tmp = $alloc(sizeof(struct $Connection));
     $tmp->$class = &$Connection$methods;
     $Connection$methods.__init__($tmp, descr);
     return $R_CONT(p$1, $tmp);
@@ -820,13 +1480,16 @@ $R $RFile$__init__ ($RFile __self__, FILE *file, $Cont c$cont) {
     __self__->file = file;
     return $R_CONT(c$cont, $None);
 }
-$R $RFile$readln$local ($RFile __self__, $Cont c$cont) {
+$WORD $RFile$readln$blocking ($WORD file) {
     char buf[BUF_SIZE];
-    char *res = fgets(buf, BUF_SIZE, __self__->file);
+    char *res = fgets(buf, BUF_SIZE, file);
     if (res)
-       return $R_CONT(c$cont, to$str(res));
+       return to$str(res);
     else
-      return $R_CONT(c$cont, $None);      
+      return $None;
+}
+$R $RFile$readln$local ($RFile __self__, $Cont c$cont) {
+    return $BLOCKING($RFile$readln$blocking, __self__->file, c$cont);
 }                  
 $R $RFile$close$local ($RFile __self__, $Cont c$cont) {
     fclose(__self__->file); 
@@ -844,7 +1507,7 @@ void $RFile$__serialize__ ($RFile self, $Serial$state state) {
 $RFile $RFile$__deserialize__ ($RFile self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct $RFile));
+            self = $alloc(sizeof(struct $RFile));
             self->$class = &$RFile$methods;
             return self;
         }
@@ -854,7 +1517,7 @@ $RFile $RFile$__deserialize__ ($RFile self, $Serial$state state) {
     return self;
 }
 $R $RFile$new(FILE *file, $Cont p$1) {
-    $RFile $tmp = malloc(sizeof(struct $RFile));
+    $RFile $tmp = $alloc(sizeof(struct $RFile));
     $tmp->$class = &$RFile$methods;
     return $RFile$methods.__init__($tmp, file, $CONSTCONT($tmp, p$1));
 }
@@ -864,12 +1527,31 @@ $R $WFile$__init__ ($WFile __self__, int descr, $Cont c$cont) {
     __self__->descriptor = descr;
     return $R_CONT(c$cont, $None);
 }
+struct $write_call {
+    int fd;
+    $str s;
+};
+// Files are always ready for writing as far as epoll is concerned, so a
+// WFile.write is done by the blocking pool, to the end of the string.
+$WORD $WFile$write$blocking ($WORD arg) {
+    struct $write_call *call = arg;
+    size_t done = 0;
+    while (done < call->s->nbytes) {
+        ssize_t r = write(call->fd, call->s->str + done, call->s->nbytes - done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        done += r;
+    }
+    $free(call, sizeof(struct $write_call));
+    return $None;
+}
 $R $WFile$write$local ($WFile __self__, $str s, $Cont c$cont) {
-    memcpy(fd_data[__self__->descriptor].buffer,s->str,s->nbytes+1);
-    int chunk_size = s->nbytes > BUF_SIZE ? BUF_SIZE : s->nbytes; 
-    int r = write(__self__->descriptor,fd_data[__self__->descriptor].buffer,chunk_size);
-    //  for now, assume str->nbytes < BUF_SIZE
-    return $R_CONT(c$cont, $None);
+    struct $write_call *call = $alloc(sizeof(struct $write_call));
+    call->fd = __self__->descriptor;
+    call->s = s;
+    return $BLOCKING($WFile$write$blocking, call, c$cont);
 }
 $R $WFile$close$local ($WFile __self__, $Cont c$cont) {
     close(__self__->descriptor); 
@@ -888,7 +1570,7 @@ void $WFile$__serialize__ ($WFile self, $Serial$state state) {
 $WFile $WFile$__deserialize__ ($WFile self, $Serial$state state) {
     if (!self) {
         if (!state) {
-            self = malloc(sizeof(struct $WFile));
+            self = $alloc(sizeof(struct $WFile));
             self->$class = &$WFile$methods;
             return self;
         }
@@ -898,7 +1580,7 @@ $WFile $WFile$__deserialize__ ($WFile self, $Serial$state state) {
     return self;
 }
 $R $WFile$new(int descr, $Cont p$1) {
-    $WFile $tmp = malloc(sizeof(struct $WFile));
+    $WFile $tmp = $alloc(sizeof(struct $WFile));
     $tmp->$class = &$WFile$methods;
     return $WFile$methods.__init__($tmp, descr, $CONSTCONT($tmp, p$1));
 }
@@ -1098,9 +1780,11 @@ void minienv$$__init__ () {
         $Connection$methods.write$local = $Connection$write$local;
         $Connection$methods.close$local = $Connection$close$local;
         $Connection$methods.on_receipt$local = $Connection$on_receipt$local;
+        $Connection$methods.on_receipt_bytes$local = $Connection$on_receipt_bytes$local;
         $Connection$methods.write = $Connection$write;
         $Connection$methods.close = $Connection$close;
         $Connection$methods.on_receipt = $Connection$on_receipt;
+        $Connection$methods.on_receipt_bytes = $Connection$on_receipt_bytes;
         $Connection$methods.__serialize__ = $Connection$__serialize__;
         $Connection$methods.__deserialize__ = $Connection$__deserialize__;
         $register(&$Connection$methods);
@@ -1133,6 +1817,19 @@ void minienv$$__init__ () {
         $WFile$methods.__deserialize__ = $WFile$__deserialize__;
         $register(&$WFile$methods);
     }
+    {
+        minienv$$l$15lambda$methods.$GCINFO = "minienv$$l$15lambda";
+        minienv$$l$15lambda$methods.$superclass = ($Super$class)&$Cont$methods;
+        minienv$$l$15lambda$methods.__bool__ = ($bool (*) (minienv$$l$15lambda))$value$methods.__bool__;
+        minienv$$l$15lambda$methods.__str__ = ($str (*) (minienv$$l$15lambda))$value$methods.__str__;
+        minienv$$l$15lambda$methods.__init__ = minienv$$l$15lambda$__init__;
+        minienv$$l$15lambda$methods.__call__ = minienv$$l$15lambda$__call__;
+        minienv$$l$15lambda$methods.__serialize__ = minienv$$l$15lambda$__serialize__;
+        minienv$$l$15lambda$methods.__deserialize__ = minienv$$l$15lambda$__deserialize__;
+        $register(&minienv$$l$15lambda$methods);
+    }
+    for (int fd = 0; fd < MAX_FD; fd++)
+        pthread_mutex_init(&fd_data[fd].out_lock, NULL);
     pipe(wakeup_pipe);
     EVENT_init();
 }
@@ -1141,22 +1838,112 @@ void reset_timeout() {
     write(wakeup_pipe[1], "!", 1);      // Write dummy data that wakes up the eventloop thread
 }
 
+// "recv_buf" is the buffer of the loop for binary receipt, see RECV_deliver.
+static void handle_event(EVENT_type *kev, char *recv_buf) {
+    struct sockaddr_in addr;
+    socklen_t socklen = sizeof(addr);
+    int fd2;
+    int count;
+
+    if (EVENT_is_wakeup(kev)) {
+        char dummy[64];
+        read(wakeup_pipe[0], dummy, sizeof dummy);      // Consume dummy data, reset timer at the end of the batch
+        return;
+    }
+    int fd = EVENT_fd(kev);
+    // A reader drains what is left and learns of the end or an error from its
+    // read, which reports the close, once
+    bool reader = fd_data[fd].kind == readhandler;
+    if (EVENT_is_error(kev) && !reader) {
+        fprintf(stderr, "EVENT error: %s\n", strerror(EVENT_errno(kev)));
+        return;
+    }
+    if (EVENT_is_write(kev) && fd_data[fd].out_armed) {
+        OUT_ready(fd);
+        if (!reader || !(EVENT_is_read(kev) || EVENT_is_eof(kev) || EVENT_is_error(kev)))
+            return;
+    }
+    if (EVENT_is_eof(kev) && !reader) {
+        report_closed(fd);
+        EVENT_del_read(fd);
+    }
+    switch (fd_data[fd].kind) {
+        case connecthandler:
+            if (EVENT_is_read(kev)) {              // we are a listener and someone tries to connect
+                while ((fd2 = accept(fd, (struct sockaddr *)&fd_data[fd].sock_addr,&socklen)) != -1) {
+                  fcntl(fd2,F_SETFL,O_NONBLOCK);
+                  fd_data[fd2].kind = connecthandler;
+                  fd_data[fd2].chandler = fd_data[fd].chandler;
+                  fd_data[fd2].sock_addr = fd_data[fd].sock_addr;
+                  fd_data[fd2].loop = fd_data[fd].loop;     // stays with the loop that accepted it
+                  bzero(fd_data[fd2].buffer,BUF_SIZE);
+                  EVENT_add_read(fd2);
+                  EVENT_mod_read_once(fd);
+                  setupConnection(fd2);
+                  printf("%s %s\n","Connection from",$getName(fd2)->str);
+                }
+            } else { // we are a client and a delayed connection attempt has succeeded
+                setupConnection(fd);
+            }
+            break;
+        case readhandler:  // data has arrived on fd to fd_data[fd].buffer
+            if (!EVENT_fd_is_read(fd)) {
+                fprintf(stderr,"internal error: readhandler/event filter mismatch on descriptor %d\n",fd);
+                exit(-1);
+            }
+            if (fd_data[fd].binary) {
+                count = read(fd,recv_buf,RECV_BYTES);
+                if (count > 0) {
+                    RECV_deliver(fd, recv_buf, count);
+                    break;
+                }
+            } else {
+                count = read(fd,&fd_data[fd].buffer,BUF_SIZE);
+                if (count > 0) {
+                    if (count < BUF_SIZE)
+                        fd_data[fd].buffer[count] = 0;
+                    fd_data[fd].rhandler->$class->__call__(fd_data[fd].rhandler,to$str(fd_data[fd].buffer));
+                    break;
+                }
+            }
+            if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                break;                          // nothing to read after all
+            if (count < 0)
+                fprintf(stderr, "EVENT error: %s\n", strerror(errno));
+            report_closed(fd);                  // orderly shutdown by the peer, or a reset
+            EVENT_del_read(fd);
+            break;
+        case nohandler:
+            fprintf(stderr,"internal error: no event handler on descriptor %d\n",fd);
+            exit(-1);
+    }
+}
+
+// Each turn harvests up to EVENT_BATCH events from one wait and dispatches
+// them all, then expires the due timers, before the workers are woken. There
+// are rts_eventloops of these threads, "arg" being the index of the loop, each
+// waiting on the descriptors assigned to it. Timers are kept by loop 0.
 void *$eventloop(void *arg) {
-    pthread_setspecific(self_key, NULL);
+    long loop = (long)arg;
+    if (URING_ON)
+        return loop == 0 ? URING_eventloop() : NULL;
+    EVENT_type kevs[EVENT_BATCH];                                                // struct epoll_event epevs[];
+    char recv_buf[RECV_BYTES];
+    int nready = 0;
     while(1) {
-        EVENT_type kev;                                                          // struct epoll_event epev;
-
-        struct sockaddr_in addr;
-        socklen_t socklen = sizeof(addr);
-        int fd2;
-        int count;
         struct timespec tspec, *timeout;
 
-        handle_timeout();
-        time_t next_time = next_timeout();
+        WAKE_hold();
+        for (int i = 0; i < nready; i++)
+            handle_event(&kevs[i], recv_buf);
+        if (loop == 0)
+            handle_timeout();
+        WAKE_release();
+
+        time_t next_time = loop == 0 ? next_timeout() : 0;
         if (next_time) {
             time_t now = current_time();
-            time_t offset = next_time - now;
+            time_t offset = next_time > now ? next_time - now : 0;
             tspec.tv_sec = offset / 1000000;
             tspec.tv_nsec = 1000 * (offset % 1000000);
             //printf("## Current time is setting timer offset %ld sec, %ld nsec\n", tspec.tv_sec, tspec.tv_nsec);
@@ -1166,72 +1953,13 @@ void *$eventloop(void *arg) {
         }
 
         // Blocking call
-        int nready = EVENT_wait(&kev, timeout);
+        nready = EVENT_wait(loop, kevs, EVENT_BATCH, timeout);
 
         if (nready<0) {
-            fprintf(stderr, "EVENT error: %s\n", strerror(errno));
-            continue;
+            if (errno != EINTR)
+                fprintf(stderr, "EVENT error: %s\n", strerror(errno));
+            nready = 0;
         }
-        if (nready == 0) {
-            continue;
-        }
-        if (EVENT_is_error(&kev)) {
-            fprintf(stderr, "EVENT error: %s\n", strerror(EVENT_errno(&kev)));
-            continue;
-        }
-        if (EVENT_is_wakeup(&kev)) {
-            char dummy;
-            read(wakeup_pipe[0], &dummy, 1);      // Consume dummy data, reset timer at the start of next turn
-            continue;
-        }
-        int fd = EVENT_fd(&kev);
-        if (EVENT_is_eof(&kev)) {
-            $str msg = $Times$str$witness->$class->__add__($Times$str$witness,$getName(fd),to$str(" closed connection\n"));
-            if (fd_data[fd].errhandler)
-                fd_data[fd].errhandler->$class ->__call__(fd_data[fd].errhandler,msg);
-            else {
-                perror("Remote host closed connection");
-                exit(-1);
-            }
-            EVENT_del_read(fd);
-        }
-        switch (fd_data[fd].kind) {
-            case connecthandler:
-                if (EVENT_is_read(&kev)) {              // we are a listener and someone tries to connect
-                    while ((fd2 = accept(fd, (struct sockaddr *)&fd_data[fd].sock_addr,&socklen)) != -1) {
-                      fcntl(fd2,F_SETFL,O_NONBLOCK);
-                      fd_data[fd2].kind = connecthandler;
-                      fd_data[fd2].chandler = fd_data[fd].chandler;
-                      fd_data[fd2].sock_addr = fd_data[fd].sock_addr;
-                      bzero(fd_data[fd2].buffer,BUF_SIZE);
-                      EVENT_add_read(fd2);
-                      EVENT_mod_read_once(fd);
-                      setupConnection(fd2);
-                      printf("%s %s\n","Connection from",$getName(fd2)->str);
-                    }
-                } else { // we are a client and a delayed connection attempt has succeeded
-                    setupConnection(fd);
-                }
-                break;
-            case readhandler:  // data has arrived on fd to fd_data[fd].buffer
-                if (EVENT_fd_is_read(fd)) {
-                    count = read(fd,&fd_data[fd].buffer,BUF_SIZE);
-                    if (count < BUF_SIZE)
-                        fd_data[fd].buffer[count] = 0;
-                    fd_data[fd].rhandler->$class->__call__(fd_data[fd].rhandler,to$str(fd_data[fd].buffer));
-                } else {
-                    fprintf(stderr,"internal error: readhandler/event filter mismatch on descriptor %d\n",fd);
-                    exit(-1);
-                }
-                break;
-            case nohandler:
-                fprintf(stderr,"internal error: no event handler on descriptor %d\n",fd);
-                exit(-1);
-        }
-        pthread_mutex_lock(&sleep_lock);
-        pthread_cond_signal(&work_to_do);
-        pthread_mutex_unlock(&sleep_lock);
-
     }
     return NULL;
 }
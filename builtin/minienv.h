@@ -25,6 +25,10 @@ typedef struct epoll_event EVENT_type;
 #endif
 
 #define BUF_SIZE 1024
+#define EVENT_BATCH 64      // max events harvested by one wait of the eventloop
+#define OUTQ_HIGH (256*1024)    // a Connection.write waits while more than this is queued for output
+#define OUTQ_LOW  (64*1024)     // ... until the eventloop has written out all but this
+#define RECV_BYTES (16*1024)    // max bytes delivered at a time by Connection.on_receipt_bytes
 
 #define MAX_FD  100
 
@@ -44,6 +48,7 @@ struct minienv$$l$11lambda;
 struct minienv$$l$12lambda;
 struct minienv$$l$13lambda;
 struct minienv$$l$14lambda;
+struct minienv$$l$15lambda;
 struct $Env;
 struct $Connection;
 struct $RFile;
@@ -62,11 +67,18 @@ typedef struct minienv$$l$11lambda *minienv$$l$11lambda;
 typedef struct minienv$$l$12lambda *minienv$$l$12lambda;
 typedef struct minienv$$l$13lambda *minienv$$l$13lambda;
 typedef struct minienv$$l$14lambda *minienv$$l$14lambda;
+typedef struct minienv$$l$15lambda *minienv$$l$15lambda;
 typedef struct $Env *$Env;
 typedef struct $Connection *$Connection;
 typedef struct $RFile *$RFile;
 typedef struct $WFile *$WFile;
 
+struct $OutChunk {
+  struct $OutChunk *next;
+  $str str;
+  long off;                // bytes of str already written
+};
+
 struct FileDescriptorData {
   HandlerCase kind;
   $function rhandler;
@@ -75,13 +87,23 @@ struct FileDescriptorData {
   $Connection conn;
   struct sockaddr_in sock_addr;
   EVENT_type event_spec;
+  long loop;               // the eventloop that waits on the descriptor
+  bool binary;             // rhandler takes a bytearray, see RECV_deliver
   char buffer[BUF_SIZE];
   int bufnxt;              // only used for RFiles; index of first unreported char
   int bufused;             //        -"-          ; nr of read chars in buffer. Equal to BUF_SIZE except before first read and (possibly) after last read.
+  struct $OutChunk *out_head, *out_tail;    // output queue, only used for Connections
+  long out_len;            // bytes in the output queue
+  bool out_armed;          // the eventloop waits for room to write out the queue
+  bool out_closing;        // close the descriptor once the queue has drained
+  $Msg out_waiting;        // the Connection.write held back until the queue is below OUTQ_LOW
+  pthread_mutex_t out_lock;
 };
 
 extern struct FileDescriptorData fd_data[MAX_FD];
-extern int kq;
+extern bool rts_io_uring;
+extern long rts_eventloops;
+extern bool rts_ddb;
 
 void reset_timeout();
 
@@ -315,6 +337,23 @@ struct minienv$$l$14lambda {
     struct minienv$$l$14lambda$class *$class;
     $WFile __self__;
 };
+struct minienv$$l$15lambda$class {
+    char *$GCINFO;
+    int $class_id;
+    $Super$class $superclass;
+    $NoneType (*__init__) (minienv$$l$15lambda, $Connection, $function, $function);
+    void (*__serialize__) (minienv$$l$15lambda, $Serial$state);
+    minienv$$l$15lambda (*__deserialize__) (minienv$$l$15lambda, $Serial$state);
+    $bool (*__bool__) (minienv$$l$15lambda);
+    $str (*__str__) (minienv$$l$15lambda);
+    $R (*__call__) (minienv$$l$15lambda, $Cont);
+};
+struct minienv$$l$15lambda {
+    struct minienv$$l$15lambda$class *$class;
+    $Connection __self__;
+    $function cb1;
+    $function cb2;
+};
 struct $Env$class {
     char *$GCINFO;
     int $class_id;
@@ -349,8 +388,13 @@ struct $Env {
     $Msg $waitsfor;
     $int64 $consume_hd;
     $Catcher $catcher;
-    $Lock $msg_lock;
+    $Msg $msg_tail;
     $long $globkey;
+    $long $home;
+    $long $mbox_len;
+    $long $mbox_cap;
+    $Actor $blocked;
+    $long $prio;
     $list argv;
 };
 struct $Connection$class {
@@ -365,9 +409,11 @@ struct $Connection$class {
     $R (*write$local) ($Connection, $str, $Cont);
     $R (*close$local) ($Connection, $Cont);
     $R (*on_receipt$local) ($Connection, $function, $function, $Cont);
+    $R (*on_receipt_bytes$local) ($Connection, $function, $function, $Cont);
     $Msg (*write) ($Connection, $str);
     $Msg (*close) ($Connection);
     $Msg (*on_receipt) ($Connection, $function, $function);
+    $Msg (*on_receipt_bytes) ($Connection, $function, $function);
 };
 struct $Connection {
     struct $Connection$class *$class;
@@ -379,9 +425,15 @@ struct $Connection {
     $Msg $waitsfor;
     $int64 $consume_hd;
     $Catcher $catcher;
-    $Lock $msg_lock;
+    $Msg $msg_tail;
     $long $globkey;
+    $long $home;
+    $long $mbox_len;
+    $long $mbox_cap;
+    $Actor $blocked;
+    $long $prio;
     int descriptor;
+    bool closed;                    // by close, after which its descriptor may be reused
 };
 struct $RFile$class {
     char *$GCINFO;
@@ -407,8 +459,13 @@ struct $RFile {
     $Msg $waitsfor;
     $int64 $consume_hd;
     $Catcher $catcher;
-    $Lock $msg_lock;
+    $Msg $msg_tail;
     $long $globkey;
+    $long $home;
+    $long $mbox_len;
+    $long $mbox_cap;
+    $Actor $blocked;
+    $long $prio;
     FILE *file;
 };
 struct $WFile$class {
@@ -435,8 +492,13 @@ struct $WFile {
     $Msg $waitsfor;
     $int64 $consume_hd;
     $Catcher $catcher;
-    $Lock $msg_lock;
+    $Msg $msg_tail;
     $long $globkey;
+    $long $home;
+    $long $mbox_len;
+    $long $mbox_cap;
+    $Actor $blocked;
+    $long $prio;
     int descriptor;
 };
 extern struct minienv$$l$1lambda$class minienv$$l$1lambda$methods;
@@ -467,6 +529,8 @@ extern struct minienv$$l$13lambda$class minienv$$l$13lambda$methods;
 minienv$$l$13lambda minienv$$l$13lambda$new($WFile, $str);
 extern struct minienv$$l$14lambda$class minienv$$l$14lambda$methods;
 minienv$$l$14lambda minienv$$l$14lambda$new($WFile);
+extern struct minienv$$l$15lambda$class minienv$$l$15lambda$methods;
+minienv$$l$15lambda minienv$$l$15lambda$new($Connection, $function, $function);
 extern struct $Env$class $Env$methods;
 $R $Env$new($list, $Cont);
 extern struct $Connection$class $Connection$methods;
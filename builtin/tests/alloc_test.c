@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "../builtin.h"
+
+#define N 100000
+
+void *blocks[N];
+
+void *remote_free(void *arg) {
+  for (int i = 0; i < N; i += 2)
+    $free(blocks[i], 48);
+  return NULL;
+}
+
+int cmp_ptr(const void *a, const void *b) {
+  uintptr_t x = *(uintptr_t*)a, y = *(uintptr_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+int main() {
+  int bad = 0;
+  for (int i = 0; i < N; i++) {
+    blocks[i] = $alloc(48);
+    memset(blocks[i], i & 0xff, 48);
+  }
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < 48; j++)
+      if (((unsigned char*)blocks[i])[j] != (i & 0xff))
+        bad++;
+  printf("distinct blocks: %s\n", bad ? "FAILED" : "OK");
+
+  // Every other block is freed by another thread, the rest locally:
+  pthread_t t;
+  pthread_create(&t, NULL, remote_free, NULL);
+  pthread_join(t, NULL);
+  for (int i = 1; i < N; i += 2)
+    $free(blocks[i], 48);
+
+  // All of them must come back, ahead of the unused rest of the last slab at most:
+  qsort(blocks, N, sizeof(void*), cmp_ptr);
+  long reused = 0;
+  for (int i = 0; i < N; i++) {
+    void *p = $alloc(48);
+    reused += bsearch(&p, blocks, N, sizeof(void*), cmp_ptr) != NULL;
+  }
+  printf("reused after remote free: %s\n", reused >= N - $ALLOC_SLAB / 48 ? "OK" : "FAILED");
+
+  void *big = $alloc(10000);
+  $free(big, 10000);
+  printf("large blocks: OK\n");
+}
@@ -27,9 +27,9 @@ import Acton.Prim
 import Acton.Env
 import Acton.QuickType
 
-convert                                 :: Env0 -> Module -> IO (Module, Env0)
-convert env0 m                          = return (runCpsM (convMod m), mapModules1 conv env0)
-  where env                             = cpsEnv env0
+convert                                 :: Bool -> Env0 -> Module -> IO (Module, Env0)
+convert preempt env0 m                  = return (runCpsM (convMod m), mapModules1 conv env0)
+  where env                             = cpsEnv preempt env0
         convMod (Module m imps ss)      = do ss' <- preSuite env ss
                                              --traceM ("######## preCPS:\n" ++ render (vcat $ map pretty ss') ++ "\n########")
                                              Module m imps <$> cps env ss'
@@ -77,11 +77,11 @@ instance Pretty Frame where
 
 type CPSEnv                             = EnvF CPSX
 
-data CPSX                               = CPSX { ctxtX :: [Frame], whereX :: Where }
+data CPSX                               = CPSX { ctxtX :: [Frame], whereX :: Where, preemptX :: Bool, actionX :: Bool }
 
 data Where                              = OnTop | InClass | InDef deriving (Eq,Show)
 
-cpsEnv env0                             = setX env0 CPSX{ ctxtX = [], whereX = OnTop }
+cpsEnv preempt env0                     = setX env0 CPSX{ ctxtX = [], whereX = OnTop, preemptX = preempt, actionX = False }
 
 ctxt env                                = ctxtX $ envX env
 
@@ -98,6 +98,10 @@ inClass env                             = whereX (envX env) == InClass
 
 inDef env                               = whereX (envX env) == InDef
 
+setActionCtxt fx env                    = modX env $ \x -> x{ actionX = contFX fx }
+
+preemptLoops env                        = preemptX (envX env) && actionX (envX env)
+
 methFX (Meth c t fx : ctx)              = fx
 methFX (f : ctx)                        = methFX ctx
 methFX []                               = fxPure
@@ -428,7 +432,9 @@ instance PreCPS Stmt where
     pre env (MutAssign l t e)           = MutAssign l <$> pre env t <*> preTop env e
     pre env (Return l e)                = Return l <$> preTop env e
     pre env (If l bs els)               = If l <$> pre env bs <*> preSuite env els
-    pre env (While l e b els)           = While l <$> pre env e <*> preSuite env b <*> preSuite env els
+    pre env (While l e b els)
+      | preemptLoops env                = While l <$> pre env e <*> preSuite env (preemptBody b) <*> preSuite env els
+      | otherwise                       = While l <$> pre env e <*> preSuite env b <*> preSuite env els
     pre env (Try l b hs els fin)        = Try l <$> preSuite env b <*> pre env hs <*> preSuite env els <*> preSuite env fin
     pre env (Decl l ds)                 = Decl l <$> pre env1 ds
       where env1                        = define (envOf ds) env
@@ -438,7 +444,7 @@ instance PreCPS Decl where
     pre env (Class l n q cs b)          = Class l n q cs <$> pre env1 b
       where env1                        = defineSelf (NoQ n) q $ defineTVars q env
     pre env (Def l n q p _k a b d fx)   = Def l n q p _k a <$> preSuite env1 b <*> pure d <*> pure fx
-      where env1                        = define (envOf p) $ defineTVars q env
+      where env1                        = define (envOf p) $ defineTVars q $ setActionCtxt fx env
 
 instance PreCPS Branch where
     pre env (Branch e ss)               = Branch  <$> pre env e <*> preSuite env ss
@@ -501,6 +507,30 @@ instance PreCPS Elem where
     pre env (Elem e)                    = Elem <$> pre env e
 
 
+-- Preemption points (actonc --preempt) ---------------------------------------------------------------
+
+-- A loop in an action is given a call to $PREEMPT at each back-edge, i.e. at the end of its body and
+-- before every continue that belongs to it. Being an action, the call turns the loop into continuation
+-- form, and $PREEMPT returns to the scheduler, which calls the loop continuation.
+-- A continue belongs to the loop unless it is in the body of a nested loop, which gets its own
+-- preemption points when pre reaches it, or in a nested def. The else branch of a nested loop
+-- still belongs to this one.
+
+preemptPoint                            = sExpr (eCall (eQVar primPREEMPT) [])
+
+preemptBody b                           = preemptConts b ++ [preemptPoint]
+
+preemptConts                            = concatMap pc
+  where pc (Continue l)                 = [preemptPoint, Continue l]
+        pc (If l bs els)                = [If l [ Branch e (preemptConts ss) | Branch e ss <- bs ] (preemptConts els)]
+        pc (While l e b els)            = [While l e b (preemptConts els)]
+        pc (For l p e b els)            = [For l p e b (preemptConts els)]
+        pc (Try l b hs els fin)         = [Try l (preemptConts b) [ Handler ex (preemptConts ss) | Handler ex ss <- hs ] (preemptConts els) (preemptConts fin)]
+        pc (With l is b)                = [With l is (preemptConts b)]
+        pc (Data l p b)                 = [Data l p (preemptConts b)]
+        pc s                            = [s]
+
+
 -- Convert types ----------------------------------------------------------------------------------------
 
 class Conv a where
@@ -49,6 +49,7 @@ primRAISE           = gPrim "RAISE"
 primRAISEFROM       = gPrim "RAISEFROM"
 primASSERT          = gPrim "ASSERT"
 primNEWACTOR        = gPrim "NEWACTOR"
+primPREEMPT         = gPrim "PREEMPT"
 
 primISINSTANCE      = gPrim "ISINSTANCE"
 primCAST            = gPrim "CAST"
@@ -103,6 +104,7 @@ primMkEnv cls def var sig =
                             (noq primRAISEFROM,     def scRAISEFROM NoDec),
                             (noq primASSERT,        def scASSERT NoDec),
                             (noq primNEWACTOR,      def scNEWACTOR NoDec),
+                            (noq primPREEMPT,       def scPREEMPT NoDec),
 
                             (noq primISINSTANCE,    def scISINSTANCE NoDec),
                             (noq primCAST,          def scCAST NoDec),
@@ -146,8 +148,13 @@ clActor cls def sig = cls [] (leftpath [cValue]) te
                         (primKW "waitsfor",   sig (monotype (tMsg tWild)) Property),
                         (primKW "consume_hd", sig (monotype $ tCon $ TC (gPrim "int64") []) Property),
                         (primKW "catcher",    sig (monotype $ tCon $ TC (gPrim "Catcher") []) Property),
-                        (primKW "msg_lock",   sig (monotype $ tCon $ TC (gPrim "Lock") []) Property),
+                        (primKW "msg_tail",   sig (monotype (tMsg tWild)) Property),
                         (primKW "globkey",    sig (monotype $ tCon $ TC (gPrim "long") []) Property),
+                        (primKW "home",       sig (monotype $ tCon $ TC (gPrim "long") []) Property),
+                        (primKW "mbox_len",   sig (monotype $ tCon $ TC (gPrim "long") []) Property),
+                        (primKW "mbox_cap",   sig (monotype $ tCon $ TC (gPrim "long") []) Property),
+                        (primKW "blocked",    sig (monotype tActor) Property),
+                        (primKW "prio",       sig (monotype $ tCon $ TC (gPrim "long") []) Property),
                         (boolKW,              def (monotype $ tFun fxPure posNil kwdNil tBool) NoDec),
                         (strKW,               def (monotype $ tFun fxPure posNil kwdNil tStr) NoDec)
                       ]
@@ -264,6 +271,10 @@ scNEWACTOR          = tSchema [Quant a [cActor]] tNEWACTOR
   where tNEWACTOR   = tFun fxPure posNil kwdNil (tVar a)
         a           = TV KType $ name "A"
 
+--  $PREEMPT        : action() -> None
+scPREEMPT           = tSchema [] tPREEMPT
+  where tPREEMPT    = tFun fxAction posNil kwdNil tNone
+
 --  $ISINSTANCE     : pure (struct,_) -> bool
 scISINSTANCE        = tSchema [] tISINSTANCE
   where tISINSTANCE = tFun fxPure (posRow tValue $ posRow tWild posNil) kwdNil tNone
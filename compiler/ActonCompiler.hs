@@ -67,6 +67,7 @@ data Args       = Args {
                     stub      :: Bool,
                     rts_debug :: Bool,
                     cpedantic :: Bool,
+                    preempt   :: Bool,
                     syspath   :: String,
                     root      :: String,
                     file      :: String
@@ -91,6 +92,7 @@ getArgs cv      = infoOption cv (long "version" <> help "Show version informatio
                     <*> switch (long "stub"    <> help "Stub (.ty) file generation only")
                     <*> switch (long "rts-debug"<> help "Include RTS debug support in output program")
                     <*> switch (long "cpedantic"<> help "Pedantic C compilation with -Werror")
+                    <*> switch (long "preempt" <> help "Let loops in actor methods yield to the RTS scheduler")
                     <*> strOption (long "syspath" <> metavar "TARGETDIR" <> value "" <> showDefault)
                     <*> strOption (long "root" <> value "" <> showDefault)
                     <*> argument str (metavar "FILE"))
@@ -341,7 +343,7 @@ runRestPasses args paths env0 parsed = do
                       --traceM ("#################### deacted env0:")
                       --traceM (Pretty.render (Pretty.pretty deactEnv))
 
-                      (cpstyled,cpsEnv) <- Acton.CPS.convert deactEnv deacted
+                      (cpstyled,cpsEnv) <- Acton.CPS.convert (preempt args) deactEnv deacted
                       iff (cps args) $ dump "cps" (Pretty.print cpstyled)
                       --traceM ("#################### cps'ed env0:")
                       --traceM (Pretty.render (Pretty.pretty cpsEnv))
@@ -396,9 +398,12 @@ buildExecutable env args paths task
                                       -- putStrLn ("## Env is " ++ prstr t)
                                       c <- Acton.CodeGen.genRoot env qn' t
                                       writeFile rootFile c
+                                      -- libActonGC is only there when the RTS was built with USE_GC
+                                      gc <- doesFileExist (joinPath [sysLib paths, "libActonGC.a"])
+                                      let cmd = ccCmd (if gc then " -lActonGC" else "")
                                       iff (ccmd args) $ do
-                                          putStrLn ccCmd
-                                      (_,_,_,hdl) <- createProcess (shell ccCmd)
+                                          putStrLn cmd
+                                      (_,_,_,hdl) <- createProcess (shell cmd)
                                       returnCode <- waitForProcess hdl
                                       case returnCode of
                                           ExitSuccess -> return()
@@ -415,14 +420,14 @@ buildExecutable env args paths task
         outbase             = outBase paths mn
         rootFile            = outbase ++ ".root.c"
         libRTSarg           = if (rts_debug args) then " -lActonRTSdebug " else " "
-        libFilesBase        = " -L" ++ projLib paths ++ " -L" ++ sysLib paths ++ libRTSarg ++ " -lActonProject -lActon -lActonDB -luuid -lprotobuf-c -lutf8proc -lpthread -lm"
+        libFilesBase gcArg  = " -L" ++ projLib paths ++ " -L" ++ sysLib paths ++ libRTSarg ++ " -lActonProject -lActon -lActonDB" ++ gcArg ++ " -luuid -lprotobuf-c -lutf8proc -lpthread -lm"
 #if defined(darwin_HOST_OS)
-        libFiles            = libFilesBase ++ " -L/usr/local/opt/util-linux/lib "
+        libFiles gcArg      = libFilesBase gcArg ++ " -L/usr/local/opt/util-linux/lib "
 #else
-        libFiles            = libFilesBase
+        libFiles gcArg      = libFilesBase gcArg
 #endif
         binFilename         = takeFileName $ dropExtension srcbase
         binFile             = joinPath [binDir paths, binFilename]
         srcbase             = srcFile paths mn
         pedantArg           = if (cpedantic args) then "-Werror" else ""
-        ccCmd               = "cc " ++ pedantArg ++ " -g -I" ++ projOut paths ++ " -I" ++ sysPath paths ++ " " ++ rootFile ++ " -o" ++ binFile ++ libFiles
+        ccCmd gcArg         = "cc " ++ pedantArg ++ " -g -I" ++ projOut paths ++ " -I" ++ sysPath paths ++ " " ++ rootFile ++ " -o" ++ binFile ++ libFiles gcArg
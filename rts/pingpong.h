@@ -87,8 +87,13 @@ struct Pingpong {
     $Actor $uterus;
     $Msg $waitsfor;
     $Catcher $catcher;
-    $Lock $msg_lock;
+    $Msg $msg_tail;
     $long $globkey;
+    $long $home;
+    $long $mbox_len;
+    $long $mbox_cap;
+    $Actor $blocked;
+    $long $prio;
     $int i;
     $int count;
 };
@@ -24,6 +24,12 @@
 #include <stdarg.h>
 #include <uuid/uuid.h>
 #include <getopt.h>
+#include <dirent.h>
+#include <errno.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include "rts.h"
 #include "../builtin/minienv.h"
@@ -120,16 +126,52 @@ extern $R $ROOT($Env, $Cont);
 $Actor root_actor = NULL;
 $Env env_actor = NULL;
 
-$Actor readyQ = NULL;
-$Lock readyQ_lock;
+// New actors get a mailbox of rts_mbox_cap messages, 0 for no limit. See
+// BLOCK_sender.
+long rts_mbox_cap = 0;
+
+
+/*
+ * Timed messages are kept in a hierarchical timing wheel (Varghese & Lauck)
+ * with TW_LEVELS levels of TW_SLOTS slots each, and a resolution of TW_TICK
+ * microseconds. A message due at tick t is stored at the lowest level l where
+ * t and the current wheel position only differ in bit group l (or below), in
+ * the slot given by that group of t. When the wheel position reaches the start
+ * of an occupied slot above level 0, its messages are cascaded down to lower
+ * levels. Insertion is thus O(1), and advancing the wheel expires every due
+ * message at once. The occupancy bitmaps let us find the next tick that has
+ * any work in O(TW_LEVELS), so idle stretches of time are skipped.
+ */
+#define TW_BITS         6
+#define TW_SLOTS        (1 << TW_BITS)
+#define TW_LEVELS       6           // covers 2^36 ticks; timers further away are re-inserted when reached
+#define TW_TICK         1000        // usec
+
+struct $TimerWheel {
+    $Msg slot[TW_LEVELS][TW_SLOTS]; // FIFO lists, linked via $next
+    $Msg last[TW_LEVELS][TW_SLOTS];
+    uint64_t occupied[TW_LEVELS];
+    int64_t tick;                   // every tick before this one has been expired
+    long count;
+};
 
-$Msg timerQ = NULL;
+struct $TimerWheel timerQ;
 $Lock timerQ_lock;
 
-int64_t next_key = -10;
-$Lock next_key_lock;
+/*
+ * Global keys are negative and handed out in decreasing order. Each thread
+ * takes KEY_BLOCK keys at a time from next_key, so creating a message or actor
+ * does not serialize the workers. In DDB mode a high-water mark is reserved in
+ * the DDB before any key below the previous mark is used, and a restarted
+ * system continues below that mark. Keys of objects that never reached the DDB
+ * are thus not reused either.
+ */
+#define KEY_BLOCK       1024
+#define KEY_RESERVE     (1L << 20)
 
-int64_t timer_consume_hd = 0;       // Lacks protection, although spinlocks wouldn't help concurrent increments. Must fix in db!
+_Atomic int64_t next_key = -10;         // last key taken by a block
+_Atomic int64_t key_mark = -10;         // keys down to this one are reserved in the DDB
+pthread_mutex_t key_mark_lock = PTHREAD_MUTEX_INITIALIZER;
 
 time_t current_time() {
     struct timeval now;
@@ -137,15 +179,7 @@ time_t current_time() {
     return now.tv_sec * 1000000 + now.tv_usec;
 }
 
-pthread_key_t self_key;
-pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t work_to_do = PTHREAD_COND_INITIALIZER;
-
-void new_work() {
-    pthread_mutex_lock(&sleep_lock);
-    pthread_cond_signal(&work_to_do);
-    pthread_mutex_unlock(&sleep_lock);
-}
+_Thread_local struct $WorkerCtx $wctx = { .id = -1 };
 
 static inline void spinlock_lock($Lock *f) {
     while (atomic_flag_test_and_set(f) == true) {
@@ -156,21 +190,72 @@ static inline void spinlock_unlock($Lock *f) {
     atomic_flag_clear(f);
 }
 
-int64_t get_next_key() {
-    spinlock_lock(&next_key_lock);
-    int64_t res = --next_key;
-    spinlock_unlock(&next_key_lock);
-    return res;
-}
-
 #define ACTORS_TABLE    ($WORD)0
 #define MSGS_TABLE      ($WORD)1
 #define MSG_QUEUE       ($WORD)2
+#define KEYS_TABLE      ($WORD)3
 
 #define TIMER_QUEUE     0           // Special key in table MSG_QUEUE
+// Special keys in table KEYS_TABLE
+#define KEY_MARK_ROW    0           // the key high-water mark
+#define KEY_ENV_ROW     1           // the key of env_actor
+#define KEY_ROOT_ROW    2           // the key of root_actor
+
+// A DDB written before there were key rows has the env and root actors at
+// these fixed keys, which they were always given then.
+#define LEGACY_ENV_KEY  -11
+#define LEGACY_ROOT_KEY -14
 
 remote_db_t * db = NULL;
 
+// Store value in row of KEYS_TABLE, in a transaction of its own.
+static void write_key_row(long row, int64_t value) {
+    $WORD column[2] = {($WORD)row, ($WORD)0};
+    while (1) {
+        uuid_t *txnid = remote_new_txn(db);
+        remote_insert_in_txn(column, 2, 1, 1, &value, sizeof value, KEYS_TABLE, txnid, db);
+        int ret = remote_commit_txn(txnid, db);
+        if (ret == VAL_STATUS_COMMIT)
+            break;
+        rtsv_printf(LOGPFX "DDB write of key row %ld = %" PRId64 " failed (%d), retrying\n", row, value, ret);
+        if (ret == NO_QUORUM_ERR)
+            usleep(100000);
+    }
+}
+
+// The value in row of KEYS_TABLE, or 0 if there is none.
+static int64_t read_key_row(long row) {
+    $WORD key = ($WORD)row;
+    db_row_t *r = remote_search_in_txn(&key, 1, KEYS_TABLE, NULL, db);
+    if (!r || !r->cells)
+        return 0;
+    db_row_t *r2 = (HEAD(r->cells))->value;
+    return *(int64_t*)r2->column_array[0];
+}
+
+// Make sure all keys down to "lowest" are covered by the mark in the DDB.
+static void reserve_keys(int64_t lowest) {
+    pthread_mutex_lock(&key_mark_lock);
+    while (lowest < key_mark) {
+        int64_t mark = key_mark - KEY_RESERVE;
+        write_key_row(KEY_MARK_ROW, mark);
+        rtsd_printf(LOGPFX "Reserved keys down to %" PRId64 "\n", mark);
+        key_mark = mark;
+    }
+    pthread_mutex_unlock(&key_mark_lock);
+}
+
+int64_t get_next_key() {
+    if ($wctx.key_next == $wctx.key_end) {
+        int64_t last = atomic_fetch_sub(&next_key, KEY_BLOCK);
+        $wctx.key_next = last - 1;
+        $wctx.key_end = last - 1 - KEY_BLOCK;
+        if (db && $wctx.key_end < key_mark)
+            reserve_keys($wctx.key_end + 1);
+    }
+    return $wctx.key_next--;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////
 
 void $Msg$__init__($Msg m, $Actor to, $Cont cont, time_t baseline, $WORD value) {
@@ -205,7 +290,7 @@ void $Msg$__serialize__($Msg self, $Serial$state state) {
 $Msg $Msg$__deserialize__($Msg res, $Serial$state state) {
     if (!res) {
         if (!state) {
-            res = malloc(sizeof (struct $Msg));
+            res = $alloc(sizeof(struct $Msg));
             res->$class = &$Msg$methods;
             return res;
         }
@@ -230,8 +315,13 @@ void $Actor$__init__($Actor a) {
     a->$waitsfor = NULL;
     a->$consume_hd = 0;
     a->$catcher = NULL;
-    atomic_flag_clear(&a->$msg_lock);
+    a->$msg_tail = NULL;
     a->$globkey = get_next_key();
+    a->$home = $wctx.node;
+    a->$mbox_len = 0;
+    a->$mbox_cap = rts_mbox_cap;
+    a->$blocked = NULL;
+    a->$prio = 0;
     rtsd_printf(LOGPFX "# New Actor %ld at %p of class %s\n", a->$globkey, a, a->$class->$GCINFO);
 }
 
@@ -248,13 +338,15 @@ $str $Actor$__str__($Actor self) {
 void $Actor$__serialize__($Actor self, $Serial$state state) {
     $step_serialize(self->$waitsfor,state);
     $val_serialize(ITEM_ID,&self->$consume_hd,state);
+    $val_serialize(ITEM_ID,&self->$mbox_cap,state);
+    $val_serialize(ITEM_ID,&self->$prio,state);
     $step_serialize(self->$catcher,state);
 }
 
 $Actor $Actor$__deserialize__($Actor res, $Serial$state state) {
     if (!res) {
         if (!state) {
-            res = malloc(sizeof(struct $Actor));
+            res = $alloc(sizeof(struct $Actor));
             res->$class = &$Actor$methods;
             return res;
         }
@@ -265,8 +357,13 @@ $Actor $Actor$__deserialize__($Actor res, $Serial$state state) {
     res->$outgoing = NULL;
     res->$waitsfor = $step_deserialize(state);
     res->$consume_hd = (long)$val_deserialize(state);
+    res->$mbox_cap = (long)$val_deserialize(state);
+    res->$prio = (long)$val_deserialize(state);
     res->$catcher = $step_deserialize(state);
-    atomic_flag_clear(&res->$msg_lock);
+    res->$msg_tail = NULL;
+    res->$home = $wctx.node;
+    res->$mbox_len = 0;
+    res->$blocked = NULL;
     return res;
 }
 
@@ -355,12 +452,38 @@ $R $ConstCont$__call__($ConstCont $this, $WORD _ignore) {
 }
 
 $Cont $CONSTCONT($WORD val, $Cont cont){
-    $ConstCont obj = malloc(sizeof(struct $ConstCont));
+    $ConstCont obj = $alloc(sizeof(struct $ConstCont));
     obj->$class = &$ConstCont$methods;
     $ConstCont$methods.__init__(obj, val, cont);
     return ($Cont)obj;
 }
 
+// A continuation that awaits message "val" and then continues with "cont", for
+// replaying a step that ended in an await but was held back by BLOCK_sender.
+// It never reaches the DDB, as held back steps are not committed.
+$R $Rewait$__call__($ConstCont $this, $WORD _ignore) {
+    return $R_WAIT($this->cont, $this->val);
+}
+
+struct $ConstCont$class $Rewait$methods = {
+    "$Rewait",
+    UNASSIGNED,
+    NULL,
+    $ConstCont$__init__,
+    $ConstCont$__serialize__,
+    $ConstCont$__deserialize__,
+    $ConstCont$__bool__,
+    $ConstCont$__str__,
+    $Rewait$__call__
+};
+
+static $Cont $REWAIT($Msg m, $Cont cont) {
+    $ConstCont obj = $alloc(sizeof(struct $ConstCont));
+    obj->$class = &$Rewait$methods;
+    $ConstCont$methods.__init__(obj, m, cont);
+    return ($Cont)obj;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////
 
 struct $Msg$class $Msg$methods = {
@@ -422,66 +545,709 @@ struct $ConstCont$class $ConstCont$methods = {
 
 ////////////////////////////////////////////////////////////////////////////////////////
 
-// Atomically enqueue actor "a" onto the global ready-queue.
-void ENQ_ready($Actor a) {
-    spinlock_lock(&readyQ_lock);
-    if (readyQ) {
-        $Actor x = readyQ;
-        while (x->$next)
-            x = x->$next;
-        x->$next = a;
+/*
+ * Ready-queues: every worker thread owns a Chase-Lev work-stealing deque
+ * ("Dynamic Circular Work-Stealing Deque", Chase & Lev 2005, with the C11
+ * memory orderings of Le et al. 2013). The owner pushes and pops at the bottom
+ * end without any locking, so an actor woken or continued by a worker is run
+ * next by that same worker, while its data is still in cache. Idle workers
+ * steal from the top end of a randomly chosen victim.
+ *
+ * Threads that are not workers (the eventloop, and main during bootstrap)
+ * cannot push onto a deque, so they use the injection queue of a NUMA node.
+ * Workers poll the queue of their node when their own deque is empty, and also
+ * every READYQ_POLL_INTERVAL dequeues so that injected actors cannot starve.
+ * At those times a worker that finds the queue empty takes the oldest actor of
+ * its own deque instead, since with no thieves around it would otherwise only
+ * ever run the newest ones.
+ *
+ * Workers are grouped per NUMA node, as found in /sys, so that the workers of
+ * a node have consecutive indexes and are pinned to the CPUs of that node.
+ * Every actor has a home node, the node of the thread that created it. An
+ * actor made ready by a worker on another node goes to the injection queue of
+ * its home node, and idle workers steal from their own node before they turn
+ * to other nodes. Slabs of the allocator are first touched by the thread that
+ * allocates from them, so with the default first-touch policy of the kernel,
+ * actors and messages already are in memory local to the node they were
+ * created on.
+ *
+ * With --rts-edf, all of this is replaced by one binary heap per node, which
+ * orders ready actors by the baseline of their head message, earliest first.
+ * Messages inherit the baseline of the step that sent them, so an endless
+ * chain of sends would keep its first baseline forever. Baselines are thus
+ * taken to be at most rts_prio_usec old when an actor is made ready. An actor
+ * of priority p is then ranked as if its baseline was p*rts_prio_usec earlier.
+ * Ranks stay put while actors wait, so waiting work ages towards the front: it
+ * is passed by work that was made ready later for at most rts_prio_usec, plus
+ * rts_prio_usec for every priority level the later work has over it. A
+ * preempted actor is ranked by the time it was preempted.
+ */
+
+struct rq_array {
+    long size;                          // always a power of two
+    _Atomic($Actor) items[];
+};
+
+struct rq_deque {
+    atomic_long top;
+    atomic_long bottom;
+    _Atomic(struct rq_array *) array;
+};
+
+#define RQ_INITIAL_SIZE 256
+#define READYQ_POLL_INTERVAL 61
+
+struct rq_node {
+    $Actor head;                        // injection queue
+    $Actor tail;
+    $Lock lock;
+    long first;                         // index of the first worker of the node
+    long count;                         // number of workers of the node
+    struct rq_entry *heap;              // with rts_edf, instead of the deques and the queue
+    long heap_len;
+    long heap_size;
+} __attribute__((aligned(64)));
+
+struct rq_entry {
+    time_t key;
+    $Actor actor;
+};
+
+bool rts_edf = false;
+long rts_prio_usec = 10000;
+
+long num_wthreads = 0;
+struct rq_deque *rqs = NULL;            // one deque per worker thread
+long num_nodes = 1;
+struct rq_node *nodes = NULL;
+static void *nodes_mem = NULL;          // the block nodes is aligned within
+int *wt_cpu = NULL;                     // CPU each worker is pinned to, -1 for none
+
+/*
+ * Idle workers park on a word of their own instead of a shared condition
+ * variable, and "num_idle" counts how many are parked. A thread that makes work
+ * available thus only pays for a wakeup when some worker is actually asleep.
+ * To not lose a wakeup, a worker announces itself as parked before it looks for
+ * work a last time, while new_work() orders its enqueue before reading
+ * num_idle.
+ */
+#define WT_RUNNING  0
+#define WT_PARKED   1
+#define WT_NOTIFIED 2
+
+struct wt_park {
+    _Atomic int state;
+#ifndef __linux__
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+} __attribute__((aligned(64)));
+
+struct wt_park *parks = NULL;           // one per worker thread
+atomic_long num_idle = 0;
+long wt_spin = 100;                     // rounds of looking for work before parking
+
+// A worker keeps processing the messages of an actor until it has done
+// rts_quantum of them or rts_quantum_usec have passed (0 for no time limit),
+// before the actor goes back to the ready queue.
+long rts_quantum = 16;
+long rts_quantum_usec = 0;
+
+// Loops in actor code compiled with actonc --preempt give up the worker once
+// a single step has run for rts_timeslice microseconds.
+long rts_timeslice = 10000;
+
+static struct rq_array *rq_array_new(long size) {
+    struct rq_array *a = malloc(sizeof(struct rq_array) + size * sizeof($Actor));
+    a->size = size;
+    return a;
+}
+
+void rq_init(long n) {
+    rqs = malloc(n * sizeof(struct rq_deque));
+    parks = aligned_alloc(sizeof(struct wt_park), n * sizeof(struct wt_park));
+    for (long i = 0; i < n; i++) {
+        atomic_init(&rqs[i].top, 0);
+        atomic_init(&rqs[i].bottom, 0);
+        atomic_init(&rqs[i].array, rq_array_new(RQ_INITIAL_SIZE));
+        atomic_init(&parks[i].state, WT_RUNNING);
+#ifndef __linux__
+        pthread_mutex_init(&parks[i].lock, NULL);
+        pthread_cond_init(&parks[i].cond, NULL);
+#endif
+    }
+}
+
+#define MAX_CPUS 1024
+
+// Parse a cpulist like "0-3,8-11" into "set". Return the number of CPUs in it,
+// or -1 if it is malformed.
+static long parse_cpulist(const char *str, bool *set) {
+    long count = 0;
+    while (*str && *str != '\n') {
+        char *end;
+        long lo = strtol(str, &end, 10), hi = lo;
+        if (end == str)
+            return -1;
+        if (*end == '-') {
+            str = end + 1;
+            hi = strtol(str, &end, 10);
+            if (end == str)
+                return -1;
+        }
+        for (long c = lo; c <= hi && c < MAX_CPUS; c++) {
+            if (c >= 0 && !set[c]) {
+                set[c] = true;
+                count++;
+            }
+        }
+        str = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end && *end != '\n')
+            return -1;
+    }
+    return count;
+}
+
+// Where the kernel lists the NUMA nodes, each with the CPUs it has
+char *numa_sysfs = "/sys/devices/system/node";
+
+// Group "n" workers per NUMA node. With "pin", there is a worker for each of
+// the "ncpus" CPUs in "cpus", and worker i is to run on the i:th of them when
+// ordered by node. Otherwise all workers are on a single node.
+void numa_init(long n, const int *cpus, long ncpus, bool pin) {
+    int *node_of = calloc(MAX_CPUS, sizeof(int));
+    int max_node = 0;
+    DIR *dir = pin ? opendir(numa_sysfs) : NULL;
+    if (dir) {
+        struct dirent *e;
+        while ((e = readdir(dir))) {
+            int node;
+            if (sscanf(e->d_name, "node%d", &node) != 1)
+                continue;
+            char path[300], buf[4096];
+            snprintf(path, sizeof(path), "%s/%s/cpulist", numa_sysfs, e->d_name);
+            FILE *f = fopen(path, "r");
+            if (!f)
+                continue;
+            if (fgets(buf, sizeof(buf), f)) {
+                bool set[MAX_CPUS] = {false};
+                parse_cpulist(buf, set);
+                for (int c = 0; c < MAX_CPUS; c++) {
+                    if (set[c])
+                        node_of[c] = node;
+                }
+            }
+            fclose(f);
+            if (node > max_node)
+                max_node = node;
+        }
+        closedir(dir);
+    }
+    // The nodes hold actors, so they must be on the collector's heap with
+    // USE_GC. aligned_alloc is not redirected there by alloc.h, so align by
+    // hand within a malloc:ed block.
+    size_t align = _Alignof(struct rq_node);
+    nodes_mem = malloc((max_node + 1) * sizeof(struct rq_node) + align - 1);
+    nodes = (struct rq_node*)(((uintptr_t)nodes_mem + align - 1) & ~(uintptr_t)(align - 1));
+    wt_cpu = malloc(n * sizeof(int));
+    num_nodes = 0;
+    long w = 0;
+    for (int node = 0; node <= max_node; node++) {
+        long first = w;
+        if (pin) {
+            for (long i = 0; i < ncpus; i++) {
+                if (node_of[cpus[i]] == node)
+                    wt_cpu[w++] = cpus[i];
+            }
+        } else {
+            while (w < n)
+                wt_cpu[w++] = -1;
+        }
+        if (w > first) {
+            struct rq_node *nd = &nodes[num_nodes++];
+            nd->head = nd->tail = NULL;
+            atomic_flag_clear(&nd->lock);
+            nd->heap = NULL;
+            nd->heap_len = nd->heap_size = 0;
+            nd->first = first;
+            nd->count = w - first;
+        }
+    }
+    free(node_of);
+}
+
+// The CPU quota of our cgroup, rounded up to whole CPUs, or 0 if there is no
+// quota.
+static long cgroup_cpus() {
+    long quota = -1, period = 0;
+    FILE *f = fopen("/sys/fs/cgroup/cpu.max", "r");                    // cgroup v2
+    if (f) {
+        char q[32];
+        if (fscanf(f, "%31s %ld", q, &period) == 2 && strcmp(q, "max") != 0)
+            quota = atol(q);
+        fclose(f);
+    } else {
+        f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");          // cgroup v1
+        if (f) {
+            if (fscanf(f, "%ld", &quota) != 1)
+                quota = -1;
+            fclose(f);
+        }
+        f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+        if (f) {
+            if (fscanf(f, "%ld", &period) != 1)
+                period = 0;
+            fclose(f);
+        }
+    }
+    if (quota <= 0 || period <= 0)
+        return 0;
+    return (quota + period - 1) / period;
+}
+
+// Replace a full array with one twice the size. The old array is never freed,
+// since a concurrent thief may still be reading from it.
+static struct rq_array *rq_grow(struct rq_deque *q, struct rq_array *a, long t, long b) {
+    struct rq_array *na = rq_array_new(a->size * 2);
+    for (long i = t; i < b; i++)
+        atomic_store_explicit(&na->items[i & (na->size - 1)],
+                              atomic_load_explicit(&a->items[i & (a->size - 1)], memory_order_relaxed),
+                              memory_order_relaxed);
+    atomic_store_explicit(&q->array, na, memory_order_release);
+    return na;
+}
+
+// Push "a" onto the bottom of deque "q". Must only be called by the owner.
+static void rq_push(struct rq_deque *q, $Actor a) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    struct rq_array *arr = atomic_load_explicit(&q->array, memory_order_relaxed);
+    if (b - t > arr->size - 1)
+        arr = rq_grow(q, arr, t, b);
+    atomic_store_explicit(&arr->items[b & (arr->size - 1)], a, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+// Pop the most recently pushed actor from deque "q", or return NULL. Must only
+// be called by the owner.
+static $Actor rq_pop(struct rq_deque *q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    struct rq_array *arr = atomic_load_explicit(&q->array, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    $Actor res = NULL;
+    if (t <= b) {
+        res = atomic_load_explicit(&arr->items[b & (arr->size - 1)], memory_order_relaxed);
+        if (t == b) {
+            // Last element: race against thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                res = NULL;
+            atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        }
     } else {
-        readyQ = a;
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
     }
+    return res;
+}
+
+// Steal the oldest actor from deque "q", or return NULL if it is empty or we
+// lost a race against the owner or another thief.
+static $Actor rq_steal(struct rq_deque *q) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t < b) {
+        struct rq_array *arr = atomic_load_explicit(&q->array, memory_order_acquire);
+        $Actor res = atomic_load_explicit(&arr->items[t & (arr->size - 1)], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            return res;
+    }
+    return NULL;
+}
+
+// Atomically enqueue actor "a" onto the injection queue of node "nd".
+static void ENQ_readyQ(struct rq_node *nd, $Actor a) {
     a->$next = NULL;
-    spinlock_unlock(&readyQ_lock);
+    spinlock_lock(&nd->lock);
+    if (nd->tail)
+        nd->tail->$next = a;
+    else
+        nd->head = a;
+    nd->tail = a;
+    spinlock_unlock(&nd->lock);
 }
 
-// Atomically dequeue and return the first actor from the global ready-queue, 
+// Atomically dequeue the first actor from the injection queue of node "nd",
 // or return NULL.
-$Actor DEQ_ready() {
-    spinlock_lock(&readyQ_lock);
-    $Actor res = readyQ;
+static $Actor DEQ_readyQ(struct rq_node *nd) {
+    if (!nd->head)                      // racy peek, avoids taking the lock when idle
+        return NULL;
+    spinlock_lock(&nd->lock);
+    $Actor res = nd->head;
     if (res) {
-        readyQ = res->$next;
+        nd->head = res->$next;
+        if (!nd->head)
+            nd->tail = NULL;
         res->$next = NULL;
     }
-    spinlock_unlock(&readyQ_lock);
+    spinlock_unlock(&nd->lock);
     return res;
 }
 
+// Insert actor "a" with rank "key" into the heap of node "nd".
+static void ENQ_heap(struct rq_node *nd, $Actor a, time_t key) {
+    spinlock_lock(&nd->lock);
+    if (nd->heap_len == nd->heap_size) {
+        nd->heap_size = nd->heap_size ? 2 * nd->heap_size : RQ_INITIAL_SIZE;
+        nd->heap = realloc(nd->heap, nd->heap_size * sizeof(struct rq_entry));
+    }
+    long i = nd->heap_len++;
+    while (i > 0) {
+        long parent = (i - 1) / 2;
+        if (nd->heap[parent].key <= key)
+            break;
+        nd->heap[i] = nd->heap[parent];
+        i = parent;
+    }
+    nd->heap[i].key = key;
+    nd->heap[i].actor = a;
+    spinlock_unlock(&nd->lock);
+}
+
+// Remove the first ranked actor from the heap of node "nd", or return NULL.
+static $Actor DEQ_heap(struct rq_node *nd) {
+    if (!__atomic_load_n(&nd->heap_len, __ATOMIC_RELAXED))    // racy peek, like DEQ_readyQ
+        return NULL;
+    spinlock_lock(&nd->lock);
+    if (!nd->heap_len) {
+        spinlock_unlock(&nd->lock);
+        return NULL;
+    }
+    $Actor res = nd->heap[0].actor;
+    struct rq_entry last = nd->heap[--nd->heap_len];
+    long i = 0;
+    while (1) {
+        long child = 2 * i + 1;
+        if (child >= nd->heap_len)
+            break;
+        if (child + 1 < nd->heap_len && nd->heap[child + 1].key < nd->heap[child].key)
+            child++;
+        if (last.key <= nd->heap[child].key)
+            break;
+        nd->heap[i] = nd->heap[child];
+        i = child;
+    }
+    nd->heap[i] = last;
+    spinlock_unlock(&nd->lock);
+    return res;
+}
+
+// Make actor "a" ready to run. On a worker thread of its home node it goes to
+// the worker's own deque, otherwise to the injection queue of its home node,
+// or with rts_edf to the heap of its home node.
+void ENQ_ready($Actor a) {
+    if (rts_edf) {
+        time_t oldest = current_time() - rts_prio_usec;
+        time_t baseline = a->$msg->$baseline < oldest ? oldest : a->$msg->$baseline;
+        ENQ_heap(&nodes[a->$home], a, baseline - a->$prio * rts_prio_usec);
+    } else if ($wctx.id >= 0 && a->$home == $wctx.node) {
+        rq_push(&rqs[$wctx.id], a);
+    } else {
+        ENQ_readyQ(&nodes[a->$home], a);
+    }
+}
+
+// Try to steal from the workers of node "nd", starting at a random victim.
+static $Actor STEAL_ready(struct rq_node *nd) {
+    unsigned int r;
+    FASTRAND(&$wctx.seed, r);
+    long start = r % nd->count;
+    for (long i = 0; i < nd->count; i++) {
+        long victim = nd->first + (start + i) % nd->count;
+        if (victim == $wctx.id)
+            continue;
+        $Actor res = rq_steal(&rqs[victim]);
+        if (res) {
+            $wctx.stats.steals++;
+            return res;
+        }
+    }
+    return NULL;
+}
+
+// Return the next actor for the current worker thread to run, or NULL if no
+// work could be found anywhere.
+$Actor DEQ_ready() {
+    struct rq_node *home = &nodes[$wctx.node];
+    $Actor res = NULL;
+    if (rts_edf) {
+        for (long i = 0; i < num_nodes && !res; i++)
+            res = DEQ_heap(&nodes[($wctx.node + i) % num_nodes]);
+        return res;
+    }
+    if (++$wctx.ticks % READYQ_POLL_INTERVAL == 0) {
+        res = DEQ_readyQ(home);
+        if (!res)
+            res = rq_steal(&rqs[$wctx.id]);
+        if (res)
+            return res;
+    }
+    res = rq_pop(&rqs[$wctx.id]);
+    if (res)
+        return res;
+    res = DEQ_readyQ(home);
+    if (res)
+        return res;
+    res = STEAL_ready(home);
+    if (res)
+        return res;
+    for (long i = 1; i < num_nodes; i++) {
+        struct rq_node *nd = &nodes[($wctx.node + i) % num_nodes];
+        res = STEAL_ready(nd);
+        if (!res)
+            res = DEQ_readyQ(nd);
+        if (res)
+            return res;
+    }
+    return NULL;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Sleep until "p" is no longer WT_PARKED.
+static void park_wait(struct wt_park *p) {
+#ifdef __linux__
+    while (atomic_load(&p->state) == WT_PARKED)
+        syscall(SYS_futex, &p->state, FUTEX_WAIT_PRIVATE, WT_PARKED, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&p->lock);
+    while (atomic_load(&p->state) == WT_PARKED)
+        pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+static void park_wake(struct wt_park *p) {
+#ifdef __linux__
+    syscall(SYS_futex, &p->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+// Wake up to "n" parked workers to pick up newly enqueued work. Workers of
+// node "node" are tried first.
+static void wake_workers(long node, long n) {
+    atomic_thread_fence(memory_order_seq_cst);      // the enqueue must be visible before num_idle is read
+    for (long i = 0; i < num_wthreads && n > 0; i++) {
+        if (atomic_load_explicit(&num_idle, memory_order_relaxed) == 0)
+            return;
+        struct wt_park *p = &parks[(nodes[node].first + i) % num_wthreads];
+        int expected = WT_PARKED;
+        if (atomic_load_explicit(&p->state, memory_order_relaxed) == WT_PARKED &&
+            atomic_compare_exchange_strong(&p->state, &expected, WT_NOTIFIED)) {
+            atomic_fetch_sub(&num_idle, 1);
+            park_wake(p);
+            n--;
+        }
+    }
+}
+
+// Wakeups asked for by this thread between WAKE_hold() and WAKE_release(),
+// per node, or NULL when not holding.
+static _Thread_local long *held_wakes = NULL;
+
+// Wake one parked worker, if there is any, to pick up newly enqueued work.
+void new_work(long node) {
+    if (held_wakes) {
+        held_wakes[node]++;
+        return;
+    }
+    wake_workers(node, 1);
+}
+
+// The eventloop makes many actors ready in a batch of events and timeouts.
+// Between WAKE_hold() and WAKE_release() the wakeups are only counted, and
+// then handed out in one go at the end of the batch.
+void WAKE_hold() {
+    static _Thread_local long *wakes = NULL;
+    if (!wakes) {
+#ifdef USE_GC
+        // Only referenced from thread-local storage, which the collector does not scan
+        wakes = GC_MALLOC_UNCOLLECTABLE(num_nodes * sizeof(long));
+#else
+        wakes = calloc(num_nodes, sizeof(long));
+#endif
+    }
+    held_wakes = wakes;
+}
+
+void WAKE_release() {
+    long *wakes = held_wakes;
+    held_wakes = NULL;
+    for (long node = 0; node < num_nodes; node++) {
+        if (wakes[node])
+            wake_workers(node, wakes[node]);
+        wakes[node] = 0;
+    }
+}
+
+// Called by a worker that found no work. Spin for a while, then park until
+// woken by new_work(). Returns an actor if one turned up before parking, else
+// NULL.
+static $Actor IDLE_wait() {
+    $Actor res;
+    for (long i = 0; i < wt_spin; i++) {
+        cpu_relax();
+        res = DEQ_ready();
+        if (res)
+            return res;
+    }
+    struct wt_park *p = &parks[$wctx.id];
+    atomic_store(&p->state, WT_PARKED);
+    atomic_fetch_add(&num_idle, 1);
+    res = DEQ_ready();
+    if (res) {
+        int expected = WT_PARKED;
+        if (atomic_compare_exchange_strong(&p->state, &expected, WT_RUNNING)) {
+            atomic_fetch_sub(&num_idle, 1);
+        } else {
+            // Someone already spent a wakeup on us, pass it on
+            atomic_store(&p->state, WT_RUNNING);
+            new_work($wctx.node);
+        }
+        return res;
+    }
+    $wctx.stats.parks++;
+    rtsd_printf(LOGPFX "Worker %ld parking after %ld steps, %ld steals, %ld parks, %ld preempts, %ld blocks\n",
+                $wctx.id, $wctx.stats.steps, $wctx.stats.steals, $wctx.stats.parks, $wctx.stats.preempts, $wctx.stats.blocks);
+    park_wait(p);
+    atomic_store(&p->state, WT_RUNNING);
+    return NULL;
+}
+
+/*
+ * Back-pressure. An actor whose mailbox holds $mbox_cap messages or more (0
+ * for no limit) is full. Messages from other actors are never delivered to a
+ * full mailbox. The sender is instead held back at the end of its step, with
+ * the messages not yet delivered left in its $outgoing and the step's result
+ * turned into a continuation that replays the end of the step, until the
+ * receiver has taken its mailbox down to half the capacity, the low-water
+ * mark. Until then, the sender is kept on the $blocked list of the receiver
+ * instead of in a ready queue. With a DDB, the step is held back before it is
+ * committed, if any of its receivers is full. The committer then delivers
+ * without checking again, so several steps that were let through at once can
+ * take a mailbox past its capacity, which is thus a soft limit with a DDB.
+ * Messages sent by the eventloop and by timers are never held back, and actors
+ * that flood each other in a cycle with bounded mailboxes can block each other
+ * for good. The capacity can be changed by the actor itself at any time, so it
+ * is read atomically by the senders, with MBOX_cap.
+ */
+
+static inline long MBOX_cap($Actor a) {
+    return __atomic_load_n(&a->$mbox_cap, __ATOMIC_RELAXED);
+}
+
+// Make the actors blocked on the mailbox of "a" ready again.
+static void UNBLOCK_senders($Actor a) {
+    $Actor b = __atomic_exchange_n(&a->$blocked, NULL, __ATOMIC_SEQ_CST);
+    while (b) {
+        $Actor next = b->$next;
+        b->$next = NULL;
+        rtsd_printf(LOGPFX "## UNBLOCK actor %ld by %ld\n", b->$globkey, a->$globkey);
+        ENQ_ready(b);
+        new_work(b->$home);
+        b = next;
+    }
+}
+
+// Block actor "a", which has a step to finish, until the mailbox of "full"
+// has drained. The receiver may have drained before "a" was on its list, so
+// check again, and unblock on its behalf if it did.
+static void BLOCK_sender($Actor a, $Actor full) {
+    rtsd_printf(LOGPFX "## BLOCK actor %ld on %ld\n", a->$globkey, full->$globkey);
+    $wctx.stats.blocks++;
+    $Actor old = __atomic_load_n(&full->$blocked, __ATOMIC_RELAXED);
+    do {
+        a->$next = old;
+    } while (!__atomic_compare_exchange_n(&full->$blocked, &old, a, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    if (__atomic_load_n(&full->$mbox_len, __ATOMIC_SEQ_CST) <= MBOX_cap(full) / 2)
+        UNBLOCK_senders(full);
+}
+
+/*
+ * Actor mailboxes are intrusive multi-producer single-consumer queues in the
+ * style of Vyukov. "a->$msg" is the head, the message currently being
+ * processed, and is only touched by the consumer once the queue is non-empty.
+ * "a->$msg_tail" is the last message, and is where producers atomically swap
+ * themselves in. A producer that finds the tail NULL has turned an empty queue
+ * into a non-empty one, and is the only one responsible for making the actor
+ * ready.
+ */
+
+// Take a place for a message in the mailbox of "a", unless it holds "cap"
+// messages or more. The message is then enqueued by ENQ_reserved.
+static bool RESERVE_msg($Actor a, long cap) {
+    long len = __atomic_load_n(&a->$mbox_len, __ATOMIC_RELAXED);
+    do {
+        if (len >= cap)
+            return false;
+    } while (!__atomic_compare_exchange_n(&a->$mbox_len, &len, len + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    return true;
+}
+
+static bool ENQ_reserved($Msg m, $Actor a);
+
 // Atomically enqueue message "m" onto the queue of actor "a", 
 // return true if the queue was previously empty.
 bool ENQ_msg($Msg m, $Actor a) {
-    bool did_enq = true;
-    spinlock_lock(&a->$msg_lock);
+    __atomic_fetch_add(&a->$mbox_len, 1, __ATOMIC_RELAXED);
+    return ENQ_reserved(m, a);
+}
+
+static bool ENQ_reserved($Msg m, $Actor a) {
     m->$next = NULL;
-    if (a->$msg) {
-        $Msg x = a->$msg;
-        while (x->$next)
-            x = x->$next;
-        x->$next = m;
-        did_enq = false;
-    } else {
+    $Msg prev = __atomic_exchange_n(&a->$msg_tail, m, __ATOMIC_ACQ_REL);
+    if (prev == NULL) {
         a->$msg = m;
+        return true;
     }
-    spinlock_unlock(&a->$msg_lock);
-    return did_enq;
+    __atomic_store_n(&prev->$next, m, __ATOMIC_RELEASE);
+    return false;
 }
 
-// Atomically dequeue the first message from the queue of actor "a",
-// return true if the queue still holds messages.
+// Dequeue the first message from the queue of actor "a", return true if the
+// queue still holds messages. Must only be called by the thread running "a".
 bool DEQ_msg($Actor a) {
-    bool has_more = false;
-    spinlock_lock(&a->$msg_lock);
-    if (a->$msg) {
-        $Msg x = a->$msg;
-        a->$msg = x->$next;
-        x->$next = NULL;
-        has_more = a->$msg != NULL;
+    $Msg x = a->$msg;
+    if (!x)
+        return false;
+    long len = __atomic_sub_fetch(&a->$mbox_len, 1, __ATOMIC_SEQ_CST);
+    if (len <= MBOX_cap(a) / 2 && __atomic_load_n(&a->$blocked, __ATOMIC_SEQ_CST))
+        UNBLOCK_senders(a);
+    $Msg next = __atomic_load_n(&x->$next, __ATOMIC_ACQUIRE);
+    if (!next) {
+        a->$msg = NULL;
+        $Msg expected = x;
+        if (__atomic_compare_exchange_n(&a->$msg_tail, &expected, NULL, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return false;
+        // A producer has swapped in a new tail but not yet linked it to x
+        while (!(next = __atomic_load_n(&x->$next, __ATOMIC_ACQUIRE)))
+            ;
     }
-    spinlock_unlock(&a->$msg_lock);
-    return has_more;
+    a->$msg = next;
+    x->$next = NULL;
+    return true;
 }
 
 // Atomically add actor "a" to the waiting list of messasge "m" if it is not frozen (and return true),
@@ -508,45 +1274,208 @@ $Actor FREEZE_waiting($Msg m) {
     return res;
 }
 
-// Atomically enqueue timed message "m" onto the global timer-queue, at position
-// given by "m->baseline".
+// Set the final response of message "m" to "value", freeze it and make every
+// actor waiting for it ready to run.
+void WAKE_waiting($Msg m, $WORD value) {
+    m->$value = value;
+    $Actor b = FREEZE_waiting(m);
+    while (b) {
+        b->$msg->$value = value;
+        b->$waitsfor = NULL;
+        $Actor c = b->$next;
+        ENQ_ready(b);
+        new_work(b->$home);
+        rtsd_printf(LOGPFX "## Waking up actor %ld : %s\n", b->$globkey, b->$class->$GCINFO);
+        b = c;
+    }
+}
+
+// Return the tick at which a message with "baseline" is due. Rounds up, so
+// that no message is ever delivered before its baseline.
+static inline int64_t tw_tick(time_t baseline) {
+    return (baseline + TW_TICK - 1) / TW_TICK;
+}
+
+// Compute the wheel level and slot where a message due at tick "t" belongs.
+static void tw_locate(int64_t t, int *level, int *idx) {
+    int64_t now = timerQ.tick;
+    int64_t max = now | (((int64_t)1 << (TW_BITS * TW_LEVELS)) - 1);
+    if (t < now)
+        t = now;
+    else if (t > max)
+        t = max;
+    int l = 0;
+    int64_t diff = t ^ now;
+    while (l < TW_LEVELS - 1 && (diff >> (TW_BITS * (l + 1))))
+        l++;
+    *level = l;
+    *idx = (t >> (TW_BITS * l)) & (TW_SLOTS - 1);
+}
+
+static void tw_insert($Msg m) {
+    int l, i;
+    tw_locate(tw_tick(m->$baseline), &l, &i);
+    m->$next = NULL;
+    if (timerQ.last[l][i])
+        timerQ.last[l][i]->$next = m;
+    else
+        timerQ.slot[l][i] = m;
+    timerQ.last[l][i] = m;
+    timerQ.occupied[l] |= (uint64_t)1 << i;
+    timerQ.count++;
+}
+
+// Detach and return the whole list of slot "i" at level "l".
+static $Msg tw_take(int l, int i) {
+    $Msg res = timerQ.slot[l][i];
+    timerQ.slot[l][i] = NULL;
+    timerQ.last[l][i] = NULL;
+    timerQ.occupied[l] &= ~((uint64_t)1 << i);
+    for ($Msg x = res; x; x = x->$next)
+        timerQ.count--;
+    return res;
+}
+
+// Return the first tick at which the wheel has messages to expire or cascade,
+// or -1 if the wheel is empty. Occupied slots at a level all lie before those
+// at the next level, so the first level with anything in it decides.
+static int64_t tw_next_tick() {
+    int64_t now = timerQ.tick;
+    for (int l = 0; l < TW_LEVELS; l++) {
+        int shift = TW_BITS * l;
+        uint64_t pending = timerQ.occupied[l] & (~(uint64_t)0 << ((now >> shift) & (TW_SLOTS - 1)));
+        if (pending) {
+            int64_t block = now >> (shift + TW_BITS) << (shift + TW_BITS);
+            return block | ((int64_t)__builtin_ctzll(pending) << shift);
+        }
+    }
+    return -1;
+}
+
+// Stable merge sort of a $next-linked list of messages on their baselines.
+static $Msg sort_baseline($Msg list) {
+    if (!list || !list->$next)
+        return list;
+    $Msg slow = list, fast = list->$next;
+    while (fast && fast->$next) {
+        slow = slow->$next;
+        fast = fast->$next->$next;
+    }
+    $Msg right = slow->$next;
+    slow->$next = NULL;
+    $Msg left = sort_baseline(list);
+    right = sort_baseline(right);
+    $Msg res = NULL, *tail = &res;
+    while (left && right) {
+        if (right->$baseline < left->$baseline) {
+            *tail = right;
+            right = right->$next;
+        } else {
+            *tail = left;
+            left = left->$next;
+        }
+        tail = &(*tail)->$next;
+    }
+    *tail = left ? left : right;
+    return res;
+}
+
+// Atomically enqueue timed message "m" onto the global timer wheel, at the
+// tick given by "m->baseline". Return true if this makes the next timeout of
+// the wheel earlier.
 bool ENQ_timed($Msg m) {
-    time_t m_baseline = m->$baseline;
-    bool new_head = false;
     spinlock_lock(&timerQ_lock);
-    $Msg x = timerQ;
-    if (x && x->$baseline <= m_baseline) {
-        $Msg next = x->$next;
-        while (next && next->$baseline <= m_baseline) {
-            x = next;
-            next = x->$next;
-        }
-        x->$next = m;
-        m->$next = next;
-    } else {
-        timerQ = m;
-        m->$next = x;
-        new_head = true;
+    if (timerQ.count == 0) {                      // nothing to skip over, so catch up with the clock
+        int64_t now = current_time() / TW_TICK;
+        if (timerQ.tick < now)
+            timerQ.tick = now;
     }
+    int64_t prev = tw_next_tick();
+    tw_insert(m);
+    bool new_head = prev < 0 || tw_next_tick() < prev;
     spinlock_unlock(&timerQ_lock);
     return new_head;
 }
 
-// Atomically dequeue and return the first message from the global timer-queue if 
-// its baseline is less or equal to "now", else return NULL.
+// Atomically advance the global timer wheel to "now", and return the list of
+// all messages whose baseline is less or equal to "now", ordered by baseline.
 $Msg DEQ_timed(time_t now) {
+    int64_t target = now / TW_TICK;
+    $Msg res = NULL, *tail = &res;
     spinlock_lock(&timerQ_lock);
-    $Msg res = timerQ;
-    if (res) {
-        if (res->$baseline <= now) {
-            timerQ = res->$next;
-            res->$next = NULL;
-        } else {
-            res = NULL;
+    while (timerQ.count > 0) {
+        int64_t t = tw_next_tick();
+        if (t > target)
+            break;
+        timerQ.tick = t;
+        for (int l = TW_LEVELS - 1; l > 0; l--) {
+            if (t & (((int64_t)1 << (TW_BITS * l)) - 1))
+                continue;
+            $Msg x = tw_take(l, (t >> (TW_BITS * l)) & (TW_SLOTS - 1));
+            while (x) {
+                $Msg next = x->$next;
+                tw_insert(x);
+                x = next;
+            }
+        }
+        $Msg x = tw_take(0, t & (TW_SLOTS - 1));
+        timerQ.tick = t + 1;
+        while (x) {
+            $Msg next = x->$next;
+            if (tw_tick(x->$baseline) > t) {      // clamped beyond the range of the wheel
+                tw_insert(x);
+            } else {
+                x->$next = NULL;
+                *tail = x;
+                tail = &x->$next;
+            }
+            x = next;
         }
     }
+    if (timerQ.tick <= target)
+        timerQ.tick = target + 1;
     spinlock_unlock(&timerQ_lock);
-    return res;
+    return sort_baseline(res);
+}
+
+// Cancel timed message "m" if it is still in the global timer wheel, wake any
+// actors waiting for it with None, and return true if so. The wheel never
+// advances past the start of an occupied slot without cascading it, so "m" can
+// only be in the slot that tw_locate gives for its tick right now. With a DDB
+// backend a message to an actor is left frozen in the wheel instead, so that it
+// is still consumed from the persistent timer queue when it expires.
+bool CANCEL_timed($Msg m) {
+    bool found = false;
+    spinlock_lock(&timerQ_lock);
+    int l, i;
+    tw_locate(tw_tick(m->$baseline), &l, &i);
+    $Msg prev = NULL;
+    for ($Msg x = timerQ.slot[l][i]; x; prev = x, x = x->$next) {
+        if (x != m)
+            continue;
+        found = m->$cont != NULL;                 // not already cancelled
+        if (db && m->$to) {
+            spinlock_lock(&m->$wait_lock);
+            m->$cont = NULL;
+            spinlock_unlock(&m->$wait_lock);
+            break;
+        }
+        if (prev)
+            prev->$next = x->$next;
+        else
+            timerQ.slot[l][i] = x->$next;
+        if (timerQ.last[l][i] == x)
+            timerQ.last[l][i] = prev;
+        if (!timerQ.slot[l][i])
+            timerQ.occupied[l] &= ~((uint64_t)1 << i);
+        timerQ.count--;
+        x->$next = NULL;
+        break;
+    }
+    spinlock_unlock(&timerQ_lock);
+    if (found)
+        WAKE_waiting(m, $None);
+    return found;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -620,6 +1549,8 @@ struct $Cont $NewRoot$cont = {
 ////////////////////////////////////////////////////////////////////////////////////////
 $R $WriteRoot$__call__($Cont $this, $WORD val) {
     root_actor = ($Actor)val;
+    if (db)
+        write_key_row(KEY_ROOT_ROW, root_actor->$globkey);
     return $R_DONE(val);
 }
 
@@ -666,6 +1597,7 @@ void BOOTSTRAP(int argc, char *argv[]) {
     $Msg m = $NEW($Msg, ancestor0, &$NewRoot$cont, now, &$WriteRoot$cont);
 
     if (db) {
+        write_key_row(KEY_ENV_ROW, env_actor->$globkey);
         create_db_queue(env_actor->$globkey);
         create_db_queue(ancestor0->$globkey);
         int ret = remote_enqueue_in_txn(($WORD*)&m->$globkey, 1, NULL, 0, MSG_QUEUE, (WORD)ancestor0->$globkey, NULL, db);
@@ -695,7 +1627,7 @@ $Catcher POP_catcher($Actor a) {
 }
 
 $Msg $ASYNC($Actor to, $Cont cont) {
-    $Actor self = ($Actor)pthread_getspecific(self_key);
+    $Actor self = $wctx.current;
     time_t baseline = 0;
     $Msg m = $NEW($Msg, to, cont, baseline, &$Done$instance);
     if (self) {                                         // $ASYNC called by actor code
@@ -705,14 +1637,14 @@ $Msg $ASYNC($Actor to, $Cont cont) {
         m->$baseline = current_time();
         if (ENQ_msg(m, to)) {
            ENQ_ready(to);
-           new_work();
+           new_work(to->$home);
         }
     }
     return m;
 }
 
 $Msg $AFTER($int sec, $Cont cont) {
-    $Actor self = ($Actor)pthread_getspecific(self_key);
+    $Actor self = $wctx.current;
     rtsd_printf(LOGPFX "# AFTER by %ld\n", self->$globkey);
     time_t baseline = self->$msg->$baseline + sec->val * 1000000;
     $Msg m = $NEW($Msg, self, cont, baseline, &$Done$instance);
@@ -724,20 +1656,145 @@ $R $AWAIT($Msg m, $Cont cont) {
     return $R_WAIT(cont, m);
 }
 
+// Suspend the calling actor for "usec" microseconds, and then continue with
+// "cont". Only the actor waits, on a message without receiver that is put
+// directly into the timer wheel, and completed by it instead of delivered.
+// That message is not persisted, so with a DDB the worker thread sleeps inline
+// instead, like $BLOCKING runs its call inline; an actor restored after a
+// restart would otherwise wait for a message that no longer exists.
+$R $SUSPEND(time_t usec, $Cont cont) {
+    if (db) {
+        struct timespec ts = { usec / 1000000, (usec % 1000000) * 1000 };
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+            ;
+        return $R_CONT(cont, $None);
+    }
+    $Msg m = $NEW($Msg, NULL, cont, current_time() + usec, NULL);
+    rtsd_printf(LOGPFX "# SUSPEND by %ld for %ld usec\n", $wctx.current->$globkey, (long)usec);
+    if (ENQ_timed(m))
+        reset_timeout();
+    return $R_WAIT(cont, m);
+}
+
+// Called by code compiled with actonc --preempt at every back-edge of a loop
+// in an actor method. $R_CONT is returned, so the C stack unwinds on every
+// iteration, and the worker continues the step right away unless it has run
+// past its slice_end, set when the message was started. In that case the actor
+// is put at the back of the ready queue of its node, so that others get to run
+// first. The clock is only read every PREEMPT_CHECK calls.
+#define PREEMPT_CHECK 256
+
+$R $PREEMPT($Cont cont) {
+    if (++$wctx.preempt_calls >= PREEMPT_CHECK) {
+        $wctx.preempt_calls = 0;
+        if (current_time() > $wctx.slice_end)
+            $wctx.preempted = true;
+    }
+    return $R_CONT(cont, $None);
+}
+
+/*
+ * Blocking C calls. $BLOCKING runs "fn" on a thread of a separate, elastic
+ * pool, and suspends the calling actor as if it awaited a message which is
+ * completed with the result of "fn". The worker thread is thus free to run
+ * other actors while the call waits for a slow disk or a name lookup. A new
+ * pool thread is started whenever there are more queued calls than idle pool
+ * threads, up to BLOCKING_MAX_THREADS, and pool threads exit after being idle
+ * for BLOCKING_IDLE_SECS. "fn" does not run in the context of any actor, so it
+ * may only affect actors by sending messages.
+ *
+ * With a DDB, the call is made inline by the worker instead. A waiting actor
+ * would otherwise be committed with a continuation that nothing completes
+ * after a restart, since the call itself cannot be persisted and resumed.
+ */
+#define BLOCKING_MAX_THREADS    256
+#define BLOCKING_IDLE_SECS      60
+
+struct $BlockingCall {
+    struct $BlockingCall *next;
+    $Msg msg;
+    $WORD (*fn)($WORD);
+    $WORD arg;
+};
+
+pthread_mutex_t blocking_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t blocking_cond = PTHREAD_COND_INITIALIZER;
+struct $BlockingCall *blocking_head = NULL, *blocking_tail = NULL;
+long blocking_queued = 0, blocking_idle = 0, blocking_threads = 0;
+
+static void *blocking_loop(void *arg) {
+    pthread_mutex_lock(&blocking_lock);
+    while (1) {
+        while (!blocking_head) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += BLOCKING_IDLE_SECS;
+            blocking_idle++;
+            int r = pthread_cond_timedwait(&blocking_cond, &blocking_lock, &deadline);
+            blocking_idle--;
+            if (r == ETIMEDOUT && !blocking_head) {
+                blocking_threads--;
+                pthread_mutex_unlock(&blocking_lock);
+                return NULL;
+            }
+        }
+        struct $BlockingCall *call = blocking_head;
+        blocking_head = call->next;
+        if (!blocking_head)
+            blocking_tail = NULL;
+        blocking_queued--;
+        pthread_mutex_unlock(&blocking_lock);
+
+        $WORD res = call->fn(call->arg);
+        rtsd_printf(LOGPFX "## Blocking call for msg %ld done\n", call->msg->$globkey);
+        WAKE_waiting(call->msg, res);
+        $free(call, sizeof(struct $BlockingCall));
+
+        pthread_mutex_lock(&blocking_lock);
+    }
+}
+
+$R $BLOCKING($WORD (*fn)($WORD), $WORD arg, $Cont cont) {
+    if (db)
+        return $R_CONT(cont, fn(arg));
+    struct $BlockingCall *call = $alloc(sizeof(struct $BlockingCall));
+    call->next = NULL;
+    call->msg = $NEW($Msg, NULL, cont, 0, NULL);     // a non-NULL $cont keeps it open for waiters
+    call->fn = fn;
+    call->arg = arg;
+    pthread_mutex_lock(&blocking_lock);
+    if (blocking_tail)
+        blocking_tail->next = call;
+    else
+        blocking_head = call;
+    blocking_tail = call;
+    blocking_queued++;
+    if (blocking_queued > blocking_idle && blocking_threads < BLOCKING_MAX_THREADS) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, blocking_loop, NULL) == 0) {
+            pthread_detach(t);
+            blocking_threads++;
+        }
+    }
+    pthread_cond_signal(&blocking_cond);
+    pthread_mutex_unlock(&blocking_lock);
+    return $R_WAIT(cont, call->msg);
+}
+
 void $PUSH($Cont cont) {
-    $Actor self = ($Actor)pthread_getspecific(self_key);
+    $Actor self = $wctx.current;
     $Catcher c = $NEW($Catcher, cont);
     PUSH_catcher(self, c);
 }
 
 void $POP() {
-    $Actor self = ($Actor)pthread_getspecific(self_key);
-    POP_catcher(self);
+    $Actor self = $wctx.current;
+    $free(POP_catcher(self), sizeof(struct $Catcher));
 }
 
-// Actually send all buffered messages of the sender
-void FLUSH_outgoing($Actor self, uuid_t *txnid) {
-    rtsd_printf(LOGPFX "#### FLUSH_outgoing messages from %ld\n", self->$globkey);
+// Detach the buffered messages of the sender, and return them in the order
+// they were sent.
+$Msg TAKE_outgoing($Actor self) {
     $Msg prev = NULL;
     $Msg m = self->$outgoing;
     self->$outgoing = NULL;
@@ -747,66 +1804,107 @@ void FLUSH_outgoing($Actor self, uuid_t *txnid) {
         prev = m;
         m = next;
     }
-    m = prev;
+    return prev;
+}
+
+// Actually send the list of messages "m", buffered during a step of "from" with
+// the given baseline. Messages with a later baseline were sent by $AFTER and go
+// to the timer wheel.
+// If the receiver of message "handoff" becomes ready, it is not made ready but
+// returned, for the caller to run directly.
+// If "full" is not NULL, delivery stops at the first message to a receiver
+// other than "from" whose mailbox is full. "full" is set to that receiver, and
+// the rest of the messages are put back as the outgoing messages of "from".
+$Actor DELIVER_outgoing($Actor from, $Msg m, time_t baseline, $Msg handoff, $Actor *full) {
+    $Actor res = NULL;
     while (m) {
         $Msg next = m->$next;
-        m->$next = NULL;
-        long dest;
-        if (m->$baseline == self->$msg->$baseline) {
+        if (m->$baseline == baseline) {
             $Actor to = m->$to;
-            if (ENQ_msg(m, to)) {
-                ENQ_ready(to);
-                new_work();
+            bool empty;
+            long cap = full && to != from ? MBOX_cap(to) : 0;
+            if (cap) {
+                if (!RESERVE_msg(to, cap)) {
+                    *full = to;
+                    while (m) {                     // in reverse, as when buffered
+                        next = m->$next;
+                        PUSH_outgoing(from, m);
+                        m = next;
+                    }
+                    break;
+                }
+                empty = ENQ_reserved(m, to);
+            } else {
+                empty = ENQ_msg(m, to);
+            }
+            if (empty) {
+                if (m == handoff) {
+                    res = to;
+                } else {
+                    ENQ_ready(to);
+                    new_work(to->$home);
+                }
             }
-            dest = to->$globkey;
         } else {
+            m->$next = NULL;
             if (ENQ_timed(m))
                 reset_timeout();
-            dest = 0;
-        }
-        if (db) {
-            int ret = remote_enqueue_in_txn(($WORD*)&m->$globkey, 1, NULL, 0, MSG_QUEUE, (WORD)dest, txnid, db);
-            if (dest) {
-                rtsd_printf(LOGPFX "   # enqueue msg %ld to queue %ld returns %d\n", m->$globkey, dest, ret);
-            } else {
-                rtsd_printf(LOGPFX "   # enqueue msg %ld to TIMER_QUEUE returns %d\n", m->$globkey, ret);
-            }
         }
         m = next;
     }
+    return res;
+}
+
+// Actually send all buffered messages of the sender
+$Actor FLUSH_outgoing($Actor self, $Msg handoff, $Actor *full) {
+    rtsd_printf(LOGPFX "#### FLUSH_outgoing messages from %ld\n", self->$globkey);
+    return DELIVER_outgoing(self, TAKE_outgoing(self), self->$msg->$baseline, handoff, full);
+}
+
+// The first receiver other than "self" of the buffered messages of "self"
+// whose mailbox is full, or NULL. For holding back a step before it is
+// committed to the DDB, as its messages are then delivered by the committer.
+static $Actor FULL_receiver($Actor self) {
+    time_t baseline = self->$msg->$baseline;
+    for ($Msg m = self->$outgoing; m; m = m->$next) {
+        $Actor to = m->$to;
+        if (m->$baseline != baseline || to == self)
+            continue;
+        long cap = MBOX_cap(to);
+        if (cap && __atomic_load_n(&to->$mbox_len, __ATOMIC_RELAXED) >= cap)
+            return to;
+    }
+    return NULL;
 }
 
 time_t next_timeout() {
-    return timerQ ? timerQ->$baseline : 0;
+    spinlock_lock(&timerQ_lock);
+    int64_t t = tw_next_tick();
+    spinlock_unlock(&timerQ_lock);
+    return t < 0 ? 0 : t * TW_TICK;
 }
 
+void COMMIT_timer($Msg, bool);
+
 void handle_timeout() {
     time_t now = current_time();
     $Msg m = DEQ_timed(now);
-    if (m) {
+    while (m) {
+        $Msg next = m->$next;
+        m->$next = NULL;
         rtsd_printf(LOGPFX "## Dequeued timed msg with baseline %ld (now is %ld)\n", m->$baseline, now);
-        if (ENQ_msg(m, m->$to)) {
+        if (!m->$cont) {                        // cancelled, see CANCEL_timed
+            if (db && m->$to)
+                COMMIT_timer(m, true);
+        } else if (!m->$to) {                          // a $SUSPEND timer, just wakes up the suspended actor
+            WAKE_waiting(m, $None);
+        } else if (db) {
+            COMMIT_timer(m, false);             // delivered once moved from the timer queue in the DDB
+        } else if (ENQ_msg(m, m->$to)) {
             ENQ_ready(m->$to);
-            new_work();
-        }
-        if (db) {
-            uuid_t *txnid = remote_new_txn(db);
-            timer_consume_hd++;
-
-            long key = TIMER_QUEUE;
-            snode_t *m_start, *m_end;
-            int entries_read = 0;
-            int64_t read_head = -1;
-            int ret0 = remote_read_queue_in_txn(($WORD)key, 0, 0, MSG_QUEUE, ($WORD)key, 1, &entries_read, &read_head, &m_start, &m_end, NULL, db);
-            rtsd_printf(LOGPFX "   # dummy read msg from TIMER_QUEUE returns %d, entries read: %d\n", ret0, entries_read);
-
-            int ret = remote_consume_queue_in_txn(($WORD)key, 0, 0, MSG_QUEUE, ($WORD)key, read_head, txnid, db);
-            rtsd_printf(LOGPFX "   # consume msg %ld from TIMER_QUEUE returns %d\n", m->$globkey, ret);
-            int ret2 = remote_enqueue_in_txn(($WORD*)&m->$globkey, 1, NULL, 0, MSG_QUEUE, (WORD)m->$to->$globkey, txnid, db);
-            rtsd_printf(LOGPFX "   # (timed) enqueue msg %ld to queue %ld returns %d\n", m->$globkey, m->$to->$globkey, ret2);
-            remote_commit_txn(txnid, db);
-            rtsd_printf(LOGPFX "############## Commit\n\n");
+            new_work(m->$to->$home);
         }
+        m = next;
     }
 }
 
@@ -896,6 +1994,23 @@ void print_actor($Actor a) {
     rtsd_printf(LOGPFX "     globkey: %ld\n", a->$globkey);
 }
 
+// Look up the actor whose key is in "row" of KEYS_TABLE among those restored,
+// falling back to key "legacy" if there is no such row. Exits if there is no
+// such actor, as the system cannot be resumed without it.
+static $WORD restore_key_actor(long row, int64_t legacy, char *what) {
+    int64_t key = read_key_row(row);
+    if (!key) {
+        rtsv_printf(LOGPFX "No key row for the %s actor in the DDB, using key %" PRId64 "\n", what, legacy);
+        key = legacy;
+    }
+    $WORD act = $dict_get(globdict, ($Hashable)$Hashable$int$witness, to$int(key), NULL);
+    if (!act) {
+        fprintf(stderr, "ERROR: The %s actor (key %" PRId64 ") is not in the DDB\n", what, key);
+        exit(1);
+    }
+    return act;
+}
+
 void deserialize_system(snode_t *actors_start) {
     snode_t *msgs_start, *msgs_end;
     remote_read_full_table_in_txn(&msgs_start, &msgs_end, MSGS_TABLE, NULL, db);
@@ -938,7 +2053,11 @@ void deserialize_system(snode_t *actors_start) {
                 min_key = key;
         }
     }
+    int64_t mark = read_key_row(KEY_MARK_ROW);
+    if (mark < min_key)
+        min_key = mark;
     next_key = min_key;
+    key_mark = min_key;
 
     rtsd_printf(LOGPFX "\n#### Msg contents:\n");
     for(snode_t * node = msgs_start; node!=NULL; node=NEXT(node)) {
@@ -1018,8 +2137,8 @@ void deserialize_system(snode_t *actors_start) {
         ENQ_timed(m);
     }
 
-    env_actor  = ($Env)$dict_get(globdict, ($Hashable)$Hashable$int$witness, to$int(-11), NULL);
-    root_actor = ($Actor)$dict_get(globdict, ($Hashable)$Hashable$int$witness, to$int(-14), NULL);
+    env_actor  = ($Env)restore_key_actor(KEY_ENV_ROW, LEGACY_ENV_KEY, "env");
+    root_actor = ($Actor)restore_key_actor(KEY_ROOT_ROW, LEGACY_ROOT_KEY, "root");
     globdict = NULL;
     rtsd_printf(LOGPFX "\n\n");
 }
@@ -1073,33 +2192,237 @@ void insert_row(long key, size_t total, $ROW row, $WORD table, uuid_t *txnid) {
     rtsd_printf(LOGPFX "   # insert to table %ld, row %ld, returns %d\n", (long)table, key, ret);
 }
 
-void serialize_msg($Msg m, uuid_t *txnid) {
-    rtsd_printf(LOGPFX "#### Serializing Msg %ld\n", m->$globkey);
-    $ROW row = $glob_serialize(($Serializable)m, try_globkey);
-    print_rows(row);
-    insert_row(m->$globkey, $total_rowsize(row), row, MSGS_TABLE, txnid);
-}
+/*
+ * Group commit. In DDB mode a worker that completes a step does not talk to the
+ * database itself. It snapshots the actor, the processed message and the
+ * messages sent by the step into a $Step record, which is queued for the
+ * committer thread. The committer gathers the steps of all actors and workers
+ * that arrive within a commit window into a single transaction. Only when that
+ * transaction is durable are the sent messages delivered, and actors awaiting
+ * the processed message woken up, so no effect of a step is observable before
+ * the step itself is. The actor may meanwhile go on with its next message, as
+ * its later steps are committed in order after this one.
+ */
+struct $Snapshot {
+    struct $Snapshot *next;
+    long key;
+    $WORD table;
+    $ROW row;
+};
+
+struct $Step {
+    struct $Step *next;
+    struct $Snapshot *rows;             // rows to write
+    bool consume;                       // consume one message from queue "queue"
+    long queue;
+    $Msg outgoing;                      // messages to send, in send order
+    time_t baseline;                    // baseline of the step, tells direct sends from timed
+    $Msg done;                          // message completed by the step, or NULL
+    $WORD value;                        // response of "done"
+};
 
-void serialize_actor($Actor a, uuid_t *txnid) {
-    rtsd_printf(LOGPFX "#### Serializing Actor %ld\n", a->$globkey);
-    $ROW row = $glob_serialize(($Serializable)a, try_globkey);
-    print_rows(row);
-    insert_row(a->$globkey, $total_rowsize(row), row, ACTORS_TABLE, txnid);
+long ddb_commit_window = 0;             // usec the committer waits for more steps before committing
+long ddb_commit_batch = 1024;           // max number of steps per transaction
+
+struct $Step *commitQ = NULL;
+struct $Step *commitQ_tail = NULL;
+pthread_mutex_t commitQ_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t commitQ_signal = PTHREAD_COND_INITIALIZER;
+
+void snapshot(struct $Step *s, $Serializable obj, long key, $WORD table) {
+    rtsd_printf(LOGPFX "#### Serializing %s %ld\n", table == ACTORS_TABLE ? "Actor" : "Msg", key);
+    struct $Snapshot *r = $alloc(sizeof(struct $Snapshot));
+    r->row = $glob_serialize(obj, try_globkey);
+    print_rows(r->row);
+    r->key = key;
+    r->table = table;
+    r->next = s->rows;
+    s->rows = r;
+}
+
+void ENQ_step(struct $Step *s) {
+    s->next = NULL;
+    pthread_mutex_lock(&commitQ_lock);
+    if (commitQ_tail)
+        commitQ_tail->next = s;
+    else
+        commitQ = s;
+    commitQ_tail = s;
+    pthread_cond_signal(&commitQ_signal);
+    pthread_mutex_unlock(&commitQ_lock);
+}
+
+// Snapshot the step "current" just took on its head message, and queue it for
+// commit. "done" is the message completed by the step with response "value",
+// or NULL if the step ended in an await.
+void COMMIT_step($Actor current, $Msg done, $WORD value) {
+    struct $Step *s = $alloc(sizeof(struct $Step));
+    s->rows = NULL;
+    if (done)
+        current->$consume_hd++;
+    snapshot(s, ($Serializable)current, current->$globkey, ACTORS_TABLE);
+    for ($Msg out = current->$outgoing; out; out = out->$next)
+        snapshot(s, ($Serializable)out, out->$globkey, MSGS_TABLE);
+    snapshot(s, ($Serializable)current->$msg, current->$msg->$globkey, MSGS_TABLE);
+    s->consume = done != NULL;
+    s->queue = current->$globkey;
+    s->outgoing = TAKE_outgoing(current);
+    s->baseline = current->$msg->$baseline;
+    s->done = done;
+    s->value = value;
+    ENQ_step(s);
+}
+
+// Queue the move of expired timed message "m" from the timer queue to the queue
+// of its receiver for commit. A cancelled message is only consumed.
+void COMMIT_timer($Msg m, bool cancelled) {
+    struct $Step *s = $alloc(sizeof(struct $Step));
+    s->rows = NULL;
+    s->consume = true;
+    s->queue = TIMER_QUEUE;
+    s->outgoing = cancelled ? NULL : m;
+    s->baseline = m->$baseline;
+    s->done = NULL;
+    s->value = NULL;
+    ENQ_step(s);
+}
+
+void commit_batch(struct $Step *batch, int n) {
+    // Steps consuming from the same queue are merged into one consume-and-advance
+    long queues[n];
+    int counts[n];
+    int nq = 0;
+    for (struct $Step *s = batch; s; s = s->next) {
+        if (!s->consume)
+            continue;
+        int i = 0;
+        while (i < nq && queues[i] != s->queue)
+            i++;
+        if (i == nq) {
+            queues[nq] = s->queue;
+            counts[nq++] = 0;
+        }
+        counts[i]++;
+    }
+    // All outgoing messages of the batch go out in a single enqueue
+    int nout = 0;
+    for (struct $Step *s = batch; s; s = s->next)
+        for ($Msg m = s->outgoing; m; m = m->$next)
+            nout++;
+    $WORD *dests = malloc(nout * sizeof($WORD));
+    $WORD *keys = malloc(nout * sizeof($WORD));
+    nout = 0;
+    for (struct $Step *s = batch; s; s = s->next) {
+        for ($Msg m = s->outgoing; m; m = m->$next) {
+            dests[nout] = ($WORD)(m->$baseline == s->baseline ? m->$to->$globkey : TIMER_QUEUE);
+            keys[nout++] = ($WORD)m->$globkey;
+        }
+    }
+    while (1) {
+        uuid_t *txnid = remote_new_txn(db);
+        for (struct $Step *s = batch; s; s = s->next) {
+            for (struct $Snapshot *r = s->rows; r; r = r->next)
+                insert_row(r->key, $total_rowsize(r->row), r->row, r->table, txnid);
+        }
+        if (nout > 0) {
+            int ret = remote_enqueue_batch_in_txn(dests, keys, 1, nout, MSG_QUEUE, txnid, db);
+            rtsd_printf(LOGPFX "   # enqueue %d msgs returns %d\n", nout, ret);
+        }
+        for (int i = 0; i < nq; i++) {
+            int64_t head = -1;
+            int ret = remote_consume_advance_queue_in_txn(($WORD)queues[i], 0, 0, MSG_QUEUE, ($WORD)queues[i], counts[i], &head, txnid, db);
+            rtsd_printf(LOGPFX "   # consume %d msgs from queue %ld returns %d, new head: %" PRId64 "\n", counts[i], queues[i], ret, head);
+        }
+        int ret = remote_commit_txn(txnid, db);
+        if (ret == VAL_STATUS_COMMIT)
+            break;
+        rtsv_printf(LOGPFX "DDB commit of %d steps failed (%d), retrying\n", n, ret);
+        if (ret == NO_QUORUM_ERR)
+            usleep(100000);
+    }
+    free(dests);
+    free(keys);
+    rtsd_printf(LOGPFX "############## Commit of %d steps\n\n", n);
+    while (batch) {
+        struct $Step *next = batch->next;
+        DELIVER_outgoing(NULL, batch->outgoing, batch->baseline, NULL, NULL);
+        if (batch->done)
+            WAKE_waiting(batch->done, batch->value);
+        struct $Snapshot *r = batch->rows;
+        while (r) {
+            struct $Snapshot *rn = r->next;
+            $free(r, sizeof(struct $Snapshot));
+            r = rn;
+        }
+        $free(batch, sizeof(struct $Step));
+        batch = next;
+    }
+}
 
-    $Msg out = a->$outgoing;
-    while (out) {
-        serialize_msg(out, txnid);
-        out = out->$next;
+void *ddb_committer(void *arg) {
+    while (1) {
+        pthread_mutex_lock(&commitQ_lock);
+        while (!commitQ)
+            pthread_cond_wait(&commitQ_signal, &commitQ_lock);
+        pthread_mutex_unlock(&commitQ_lock);
+        if (ddb_commit_window > 0)
+            usleep(ddb_commit_window);
+        pthread_mutex_lock(&commitQ_lock);
+        struct $Step *batch = commitQ, *last = commitQ;
+        int n = 1;
+        while (n < ddb_commit_batch && last->next) {
+            last = last->next;
+            n++;
+        }
+        commitQ = last->next;
+        if (!commitQ)
+            commitQ_tail = NULL;
+        last->next = NULL;
+        pthread_mutex_unlock(&commitQ_lock);
+        commit_batch(batch, n);
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
 
 void *main_loop(void *arg) {
+#ifdef USE_GC
+    // The collector does not scan thread-local storage, and workers never exit
+    GC_add_roots(&$wctx, &$wctx + 1);
+#endif
+    $wctx.id = (long)arg - 1;           // thread 0 is the eventloop
+    for (long n = 0; n < num_nodes; n++) {
+        if ($wctx.id >= nodes[n].first && $wctx.id < nodes[n].first + nodes[n].count)
+            $wctx.node = n;
+    }
+    GET_RANDSEED(&$wctx.seed, $wctx.id);
+    $Actor next = NULL;                 // actor to run without going through the ready queue
+    bool same = false;                  // next continues the quantum of current
+    bool resumed = false;               // next continues the step of current
+    long served = 0;                    // messages processed by the current actor
+    time_t deadline = 0;
     while (1) {
-        $Actor current = DEQ_ready();
+        $Actor current = next;
+        next = NULL;
+        if (!current) {
+            current = DEQ_ready();
+            if (!current)
+                current = IDLE_wait();
+        }
+        if (!same) {
+            served = 0;
+            if (rts_quantum_usec)
+                deadline = current_time() + rts_quantum_usec;
+        }
+        same = false;
         if (current) {
-            pthread_setspecific(self_key, current);
+            if (!resumed) {
+                $wctx.slice_end = current_time() + rts_timeslice;
+                $wctx.preempt_calls = 0;
+            }
+            resumed = false;
+            $wctx.current = current;
+            $wctx.stats.steps++;
             $Msg m = current->$msg;
             $Cont cont = m->$cont;
             $WORD val = m->$value;
@@ -1108,87 +2431,90 @@ void *main_loop(void *arg) {
             $R r = cont->$class->__call__(cont, val);
             switch (r.tag) {
                 case $RDONE: {
+                    $Actor full = NULL;             // receiver that current is to be blocked on
                     if (db) {
-                        uuid_t * txnid = remote_new_txn(db);
-                        current->$consume_hd++;
-                        serialize_actor(current, txnid);
-                        FLUSH_outgoing(current, txnid);
-                        serialize_msg(current->$msg, txnid);
-
-                        long key = current->$globkey;
-                        snode_t *m_start, *m_end;
-                        int entries_read = 0;
-                        int64_t read_head = -1;
-                        int ret0 = remote_read_queue_in_txn(($WORD)key, 0, 0, MSG_QUEUE, ($WORD)key, 1, &entries_read, &read_head, &m_start, &m_end, NULL, db);
-                        rtsd_printf(LOGPFX "   # dummy read msg from queue %ld returns %d, entries read: %d\n", key, ret0, entries_read);
-
-                        int ret = remote_consume_queue_in_txn(($WORD)key, 0, 0, MSG_QUEUE, ($WORD)key, read_head, txnid, db);
-                        rtsd_printf(LOGPFX "   # consume msg %ld from queue %ld returns %d\n", m->$globkey, key, ret);
-                        remote_commit_txn(txnid, db);
-                        rtsd_printf(LOGPFX "############## Commit\n\n");
+                        full = FULL_receiver(current);
+                        if (!full)
+                            COMMIT_step(current, m, r.value);   // sends and wakeups are done once committed
                     } else {
-                        FLUSH_outgoing(current, NULL);
+                        FLUSH_outgoing(current, NULL, &full);
+                        if (!full)
+                            WAKE_waiting(m, r.value);           // m->value holds the response, m->cont = NULL stops further m->waiting additions
                     }
-
-                    m->$value = r.value;                 // m->value holds the response,
-                    $Actor b = FREEZE_waiting(m);        // so set m->cont = NULL and stop further m->waiting additions
-                    while (b) {
-                        b->$msg->$value = r.value;
-                        b->$waitsfor = NULL;
-                        $Actor c = b->$next;
-                        ENQ_ready(b);
-                        new_work();
-                        rtsd_printf(LOGPFX "## Waking up actor %ld : %s\n", b->$globkey, b->$class->$GCINFO);
-                        b = c;
+                    if (full) {
+                        m->$cont = $CONSTCONT(r.value, &$Done$instance);
+                        BLOCK_sender(current, full);
+                        break;
                     }
                     rtsd_printf(LOGPFX "## DONE actor %ld : %s\n", current->$globkey, current->$class->$GCINFO);
                     if (DEQ_msg(current)) {
-                        ENQ_ready(current);
+                        if (++served < rts_quantum && (!rts_quantum_usec || current_time() < deadline)) {
+                            next = current;
+                            same = true;
+                        } else
+                            ENQ_ready(current);
                     }
                     break;
                 }
                 case $RCONT: {
                     m->$cont = r.cont;
                     m->$value = r.value;
+                    if ($wctx.preempted) {
+                        rtsd_printf(LOGPFX "## PREEMPT actor %ld : %s\n", current->$globkey, current->$class->$GCINFO);
+                        $wctx.preempted = false;
+                        $wctx.stats.preempts++;
+                        if (rts_edf)
+                            ENQ_heap(&nodes[current->$home], current, current_time());
+                        else
+                            ENQ_readyQ(&nodes[current->$home], current);
+                        break;
+                    }
                     rtsd_printf(LOGPFX "## CONT actor %ld : %s\n", current->$globkey, current->$class->$GCINFO);
-                    ENQ_ready(current);
+                    next = current;
+                    same = resumed = true;
                     break;
                 }
                 case $RFAIL: {
                     $Catcher c = POP_catcher(current);
                     m->$cont = c->$cont;
                     m->$value = r.value;
+                    $free(c, sizeof(struct $Catcher));
                     ENQ_ready(current);
                     break;
                 }
                 case $RWAIT: {
+                    m->$cont = r.cont;
+                    $Msg x = ($Msg)r.value;
+                    $Actor full = NULL;
+                    current->$waitsfor = x;             // set before current can be woken up by another thread
                     if (db) {
-                        uuid_t * txnid = remote_new_txn(db);
-                        serialize_actor(current, txnid);
-                        FLUSH_outgoing(current, txnid);
-                        serialize_msg(current->$msg, txnid);
-                        remote_commit_txn(txnid, db);
-                        rtsd_printf(LOGPFX "############## Commit\n\n");
+                        full = FULL_receiver(current);
+                        if (!full)
+                            COMMIT_step(current, NULL, NULL);
                     } else {
-                        FLUSH_outgoing(current, NULL);
+                        // Run the receiver of x right away on this worker, while
+                        // current is still warm in the cache
+                        next = FLUSH_outgoing(current, x, &full);
+                        if (next)
+                            rtsd_printf(LOGPFX "## Handing off to actor %ld\n", next->$globkey);
+                    }
+                    if (full) {
+                        current->$waitsfor = NULL;
+                        m->$cont = $REWAIT(x, r.cont);
+                        BLOCK_sender(current, full);
+                        break;
                     }
-                    m->$cont = r.cont;
-                    $Msg x = ($Msg)r.value;
                     if (ADD_waiting(current, x)) {      // x->cont != NULL: x is still being processed so current was added to x->waiting
                         rtsd_printf(LOGPFX "## AWAIT actor %ld : %s\n", current->$globkey, current->$class->$GCINFO);
-                        current->$waitsfor = x;
                     } else {                            // x->cont == NULL: x->value holds the final response, current is not in x->waiting
                         rtsd_printf(LOGPFX "## AWAIT/wakeup actor %ld : %s\n", current->$globkey, current->$class->$GCINFO);
+                        current->$waitsfor = NULL;
                         m->$value = x->$value;
                         ENQ_ready(current);
                     }
                     break;
                 }
             }
-        } else {
-            pthread_mutex_lock(&sleep_lock);
-            pthread_cond_wait(&work_to_do, &sleep_lock);
-            pthread_mutex_unlock(&sleep_lock);
         }
     }
 }
@@ -1227,24 +2553,47 @@ void $register_rts () {
  *   Application sees: [./app, foo, --bar, --, --rts-verbose]
  */
 int main(int argc, char **argv) {
+#ifdef USE_GC
+    GC_INIT();
+#endif
     int ch = 0;
     uint ddb_no_host = 0;
     char **ddb_host = NULL;
     int ddb_port = 32000;
     int ddb_replication = 3;
+    char *rts_cpus = NULL;
+    int eventloop_cpu = -1;
     int new_argc = argc;
 
     static struct option long_options[] = {
+        {"rts-cpus", required_argument, NULL, 'c'},
         {"rts-debug", no_argument, NULL, 'd'},
+        {"rts-ddb-commit-batch", required_argument, NULL, 'B'},
+        {"rts-ddb-commit-window", required_argument, NULL, 'W'},
         {"rts-ddb-host", required_argument, NULL, 'h'},
         {"rts-ddb-port", required_argument, NULL, 'p'},
         {"rts-ddb-replication", required_argument, NULL, 'r'},
+        {"rts-edf", no_argument, NULL, 'E'},
+        {"rts-eventloop-cpu", required_argument, NULL, 'e'},
+        {"rts-eventloops", required_argument, NULL, 'L'},
+        {"rts-io-uring", no_argument, NULL, 'U'},
+        {"rts-mailbox-cap", required_argument, NULL, 'm'},
+        {"rts-priority-usec", required_argument, NULL, 'P'},
+        {"rts-quantum", required_argument, NULL, 'q'},
+        {"rts-quantum-usec", required_argument, NULL, 'Q'},
+        {"rts-spin", required_argument, NULL, 'S'},
+        {"rts-timeslice", required_argument, NULL, 'T'},
         {"rts-verbose", no_argument, NULL, 'v'},
+        {"rts-wthreads", required_argument, NULL, 'w'},
         {NULL, 0, NULL, 0}
     };
 
     while ((ch = getopt_long(argc, argv, "-", long_options, NULL)) != -1) {
         switch (ch) {
+            case 'c':
+                new_argc -= 2;
+                rts_cpus = optarg;
+                break;
             case 'd':
                 new_argc--;
                 #ifndef RTS_DEBUG
@@ -1256,11 +2605,35 @@ int main(int argc, char **argv) {
                 // Enabling rts debug implies verbose RTS output too
                 rts_verbose = 10;
                 break;
+            case 'B':
+                new_argc -= 2;
+                ddb_commit_batch = atol(optarg);
+                if (ddb_commit_batch < 1)
+                    ddb_commit_batch = 1;
+                break;
+            case 'W':
+                new_argc -= 2;
+                ddb_commit_window = atol(optarg);
+                break;
             case 'h':
                 new_argc -= 2;
                 ddb_host = realloc(ddb_host, ++ddb_no_host * sizeof *ddb_host);
                 ddb_host[ddb_no_host-1] = optarg;
                 break;
+            case 'E':
+                new_argc--;
+                rts_edf = true;
+                break;
+            case 'e':
+                new_argc -= 2;
+                eventloop_cpu = atoi(optarg);
+                break;
+            case 'L':
+                new_argc -= 2;
+                rts_eventloops = atoi(optarg);
+                if (rts_eventloops < 1)
+                    rts_eventloops = 1;
+                break;
             case 'p':
                 new_argc -= 2;
                 ddb_port = atoi(optarg);
@@ -1269,10 +2642,42 @@ int main(int argc, char **argv) {
                 new_argc -= 2;
                 ddb_replication = atoi(optarg);
                 break;
+            case 'U':
+                new_argc--;
+                rts_io_uring = true;
+                break;
+            case 'm':
+                new_argc -= 2;
+                rts_mbox_cap = atol(optarg);
+                break;
+            case 'P':
+                new_argc -= 2;
+                rts_prio_usec = atol(optarg);
+                break;
+            case 'q':
+                new_argc -= 2;
+                rts_quantum = atol(optarg);
+                break;
+            case 'Q':
+                new_argc -= 2;
+                rts_quantum_usec = atol(optarg);
+                break;
+            case 'S':
+                new_argc -= 2;
+                wt_spin = atol(optarg);
+                break;
+            case 'T':
+                new_argc -= 2;
+                rts_timeslice = atol(optarg);
+                break;
             case 'v':
                 new_argc--;
                 rts_verbose = 1;
                 break;
+            case 'w':
+                new_argc -= 2;
+                num_wthreads = atol(optarg);
+                break;
         }
     }
     char** new_argv = malloc((new_argc+1) * sizeof *new_argv);
@@ -1299,14 +2704,58 @@ int main(int argc, char **argv) {
     }
     new_argv[new_argc] = NULL;
 
+    // The CPUs to run on are those given by --rts-cpus, or else those we are
+    // allowed to run on, less the one reserved for the eventloop.
+    bool cpu_set[MAX_CPUS] = {false};
     long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-    long num_wthreads = num_cores;
-    if (num_wthreads < 4) {
-        rtsd_printf(LOGPFX "Detected %ld CPUs: Using %ld worker threads, due to low CPU count. No CPU affinity used.\n", num_cores, num_wthreads);
-        num_wthreads = 4;
+    if (rts_cpus) {
+        if (parse_cpulist(rts_cpus, cpu_set) <= 0) {
+            fprintf(stderr, "ERROR: Invalid CPU list for --rts-cpus: %s\n", rts_cpus);
+            exit(1);
+        }
+    } else {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int c = 0; c < 8 * (int)sizeof(allowed) && c < MAX_CPUS; c++)
+                cpu_set[c] = CPU_ISSET(c, &allowed);
+        } else {
+            for (int c = 0; c < num_cores && c < MAX_CPUS; c++)
+                cpu_set[c] = true;
+        }
+    }
+    if (eventloop_cpu >= 0 && eventloop_cpu < MAX_CPUS)
+        cpu_set[eventloop_cpu] = false;
+    int cpus[MAX_CPUS];
+    long num_cpus = 0;
+    for (int c = 0; c < MAX_CPUS; c++) {
+        if (cpu_set[c])
+            cpus[num_cpus++] = c;
+    }
+    if (num_cpus == 0) {
+        fprintf(stderr, "ERROR: No CPUs left for worker threads\n");
+        exit(1);
+    }
+    // Unless given, use one worker per CPU, but no more than our cgroup quota
+    // allows for, and no less than 4.
+    long quota = cgroup_cpus();
+    if (num_wthreads <= 0) {
+        num_wthreads = num_cpus;
+        if (quota > 0 && quota < num_wthreads)
+            num_wthreads = quota;
+        if (num_wthreads < 4)
+            num_wthreads = 4;
+    }
+    // Only do affinity when we have a 1:1 mapping of worker threads to CPUs.
+    // Otherwise the worker threads roam freely across the CPUs.
+    bool pin = num_wthreads == num_cpus;
+    if (pin) {
+        rtsd_printf(LOGPFX "Using %ld CPUs: Using %ld worker threads for 1:1 mapping with CPU affinity set.\n", num_cpus, num_wthreads);
     } else {
-        rtsd_printf(LOGPFX "Detected %ld CPUs: Using %ld worker threads for 1:1 mapping with CPU affinity set.\n", num_cores, num_wthreads);
+        rtsd_printf(LOGPFX "Using %ld CPUs (cgroup quota %ld): Using %ld worker threads, no CPU affinity used.\n", num_cpus, quota, num_wthreads);
     }
+    numa_init(num_wthreads, cpus, num_cpus, pin);
+    rtsd_printf(LOGPFX "Workers are spread over %ld NUMA node(s)\n", num_nodes);
     $register_builtin();
     minienv$$__init__();
     $register_rts();
@@ -1317,6 +2766,7 @@ int main(int argc, char **argv) {
         GET_RANDSEED(&seed, 0);
         rtsv_printf(LOGPFX "Using distributed database backend replication factor of %d\n", ddb_replication);
         db = get_remote_db(ddb_replication);
+        rts_ddb = true;
         for (int i=0; i<ddb_no_host; i++) {
             char * colon = strchr(ddb_host[i], ':');
             int port = ddb_port;
@@ -1347,7 +2797,6 @@ int main(int argc, char **argv) {
             int indices[] = {0};
             db_schema_t* db_schema = db_create_schema(NULL, 1, indices, 1, indices, 0, indices, 0);
             create_db_queue(TIMER_QUEUE);
-            timer_consume_hd = 0;
             BOOTSTRAP(new_argc, new_argv);
             rtsv_printf(LOGPFX "done\n");
         }
@@ -1355,28 +2804,45 @@ int main(int argc, char **argv) {
         BOOTSTRAP(new_argc, new_argv);
     }
 
-    pthread_key_create(&self_key, NULL);
-    // Start worker threads, normally one per CPU. On small machines with less
-    // than 4 cores, we start more worker threads than CPUs.
-    pthread_t threads[num_wthreads];
-    cpu_set_t cpu_set;
-    for(int idx = 0; idx <= num_wthreads; ++idx) {
+    rq_init(num_wthreads);
+    if (db) {
+        pthread_t committer;
+        pthread_create(&committer, NULL, ddb_committer, NULL);
+    }
+    // Start the eventloop and the worker threads, normally one per CPU. On
+    // small machines with less than 4 cores, we start more worker threads than
+    // CPUs. Any further eventloops come last, and are not pinned.
+    pthread_t threads[num_wthreads + rts_eventloops];
+    cpu_set_t affinity;
+    for(long idx = 0; idx <= num_wthreads; ++idx) {
         if (idx==0) {
             pthread_create(&threads[idx], NULL, $eventloop, (void*)idx);
+            if (eventloop_cpu >= 0) {
+                CPU_ZERO(&affinity);
+                CPU_SET(eventloop_cpu, &affinity);
+                pthread_setaffinity_np(threads[idx], sizeof(affinity), &affinity);
+            }
         } else {
             pthread_create(&threads[idx], NULL, main_loop, (void*)idx);
-        }
-        // Only do affinity when we have a 1:1 mapping of eventloop / worker
-        // threads to CPUs. Otherwise we are on a small system and we let our
-        // worker threads roam freely across CPU cores.
-        if (num_cores == num_wthreads) {
-            CPU_ZERO(&cpu_set);
-            CPU_SET(idx, &cpu_set);
-            pthread_setaffinity_np(threads[idx], sizeof(cpu_set), &cpu_set);
+            if (wt_cpu[idx-1] >= 0) {
+                CPU_ZERO(&affinity);
+                CPU_SET(wt_cpu[idx-1], &affinity);
+                pthread_setaffinity_np(threads[idx], sizeof(affinity), &affinity);
+            } else if (rts_cpus || eventloop_cpu >= 0) {
+                // Keep roaming workers to the given CPUs, and off the eventloop's
+                CPU_ZERO(&affinity);
+                for (long i = 0; i < num_cpus; i++)
+                    CPU_SET(cpus[i], &affinity);
+                pthread_setaffinity_np(threads[idx], sizeof(affinity), &affinity);
+            }
         }
     }
-    
-    for(int idx = 0; idx < num_cores; ++idx) {
+
+    for(long loop = 1; loop < rts_eventloops; ++loop) {
+        pthread_create(&threads[num_wthreads + loop], NULL, $eventloop, (void*)loop);
+    }
+
+    for(long idx = 0; idx < num_wthreads + rts_eventloops; ++idx) {
         pthread_join(threads[idx], NULL);
     }
     return 0;
@@ -23,10 +23,6 @@ struct $function;
 struct $Cont;
 struct $ConstCont;
 
-extern pthread_key_t self_key;
-extern pthread_mutex_t sleep_lock;
-extern pthread_cond_t work_to_do;
-
 typedef struct $Msg *$Msg;
 typedef struct $Actor *$Actor;
 typedef struct $Catcher *$Catcher;
@@ -34,6 +30,30 @@ typedef struct $function *$function;
 typedef struct $Cont *$Cont;
 typedef struct $ConstCont *$ConstCont;
 
+// Per-thread RTS state. Threads that are not workers (the eventloop, the DDB
+// committer) have id -1 and never a current actor.
+struct $WorkerCtx {
+    long id;                            // index of the worker thread
+    long node;                          // NUMA node of the worker thread, 0 for others
+    $Actor current;                     // actor whose continuation is running
+    unsigned int seed;                  // for picking steal victims
+    unsigned int ticks;                 // for polling the injection queue
+    int64_t key_next;                   // next global key to hand out
+    int64_t key_end;                    // key_next reaching this ends the block
+    time_t slice_end;                   // $PREEMPT yields once this time is passed
+    unsigned int preempt_calls;         // $PREEMPT calls since the clock was last read
+    bool preempted;                     // current continues at the back of the ready queue
+    struct {
+        long steps;                     // continuations run
+        long steals;                    // actors taken from other workers
+        long parks;                     // times the worker went to sleep
+        long preempts;                  // steps cut short by $PREEMPT
+        long blocks;                    // times an actor was blocked on a full mailbox
+    } stats;
+};
+
+extern _Thread_local struct $WorkerCtx $wctx;
+
 extern struct $Msg$class $Msg$methods;
 extern struct $Actor$class $Actor$methods;
 extern struct $Catcher$class $Catcher$methods;
@@ -102,11 +122,18 @@ struct $Actor {
     $Actor $next;
     $Msg $msg;
     $Msg $outgoing;
+    $Actor $offspring;
+    $Actor $uterus;
     $Msg $waitsfor;
     $int64 $consume_hd;
     $Catcher $catcher;
-    $Lock $msg_lock;
+    $Msg $msg_tail;
     $long $globkey;
+    $long $home;
+    $long $mbox_len;
+    $long $mbox_cap;
+    $Actor $blocked;
+    $long $prio;
 };
 
 struct $Catcher$class {
@@ -162,10 +189,14 @@ $Cont $CONSTCONT($WORD, $Cont);
 $Msg $ASYNC($Actor, $Cont);
 $Msg $AFTER($int, $Cont);
 $R $AWAIT($Msg, $Cont);
+$R $SUSPEND(time_t, $Cont);
+$R $PREEMPT($Cont);
+$R $BLOCKING($WORD (*)($WORD), $WORD, $Cont);
+void WAKE_waiting($Msg, $WORD);
 
 void init_db_queue(long);
 
-#define $NEWACTOR($T)       ({ $T $t = malloc(sizeof(struct $T)); \
+#define $NEWACTOR($T)       ({ $T $t = $alloc(sizeof(struct $T)); \
                                $t->$class = &$T ## $methods; \
                                $Actor$methods.__init__(($Actor)$t); \
                                init_db_queue($t->$globkey); \
@@ -174,11 +205,11 @@ void init_db_queue(long);
 void $PUSH($Cont);
 void $POP();
 
-extern $Msg timerQ;
-
 time_t current_time();
 time_t next_timeout();
 void handle_timeout();
+void WAKE_hold();
+void WAKE_release();
 
 //typedef $int $Env;
 
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Unit test of the group commit of the steps queued for the DDB committer. The
+ * RTS is included whole and never started, with the DDB calls of commit_batch
+ * replaced by fakes that record them, so no DDB is needed.
+ */
+
+#define remote_new_txn                      fake_new_txn
+#define remote_commit_txn                   fake_commit_txn
+#define remote_insert_in_txn                fake_insert_in_txn
+#define remote_enqueue_batch_in_txn         fake_enqueue_batch_in_txn
+#define remote_consume_advance_queue_in_txn fake_consume_advance_queue_in_txn
+#define main rts_main
+#include "../rts.c"
+#undef main
+
+void $ROOTINIT() {}
+$R $ROOT($Env env, $Cont then) { return $R_CONT(then, $None); }
+
+extern int wakeup_pipe[2];              // of the eventloop, which timed messages wake
+
+int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// What the fakes saw in the last transaction
+#define MAX_CALLS 16
+uuid_t txn;
+int txns = 0, commits = 0, fail_commits = 0;
+int inserts, enqueues, consumes;
+long enq_dests[MAX_CALLS], enq_keys[MAX_CALLS];
+int enq_count;
+long cons_queues[MAX_CALLS];
+int cons_counts[MAX_CALLS];
+$Actor receiver;
+long delivered_at_commit = -1;          // mailbox length of "receiver" when the commit was made
+
+uuid_t *fake_new_txn(remote_db_t *db) {
+    txns++;
+    inserts = enqueues = consumes = enq_count = 0;
+    return &txn;
+}
+
+int fake_commit_txn(uuid_t *txnid, remote_db_t *db) {
+    if (fail_commits > 0) {
+        fail_commits--;
+        return VAL_STATUS_ABORT;
+    }
+    commits++;
+    delivered_at_commit = receiver->$mbox_len;
+    return VAL_STATUS_COMMIT;
+}
+
+int fake_insert_in_txn(WORD *column_values, int no_cols, int no_primary_keys, int no_clustering_keys, WORD blob, size_t blob_size, WORD table_key, uuid_t *txnid, remote_db_t *db) {
+    inserts++;
+    return 0;
+}
+
+int fake_enqueue_batch_in_txn(WORD *queue_ids, WORD *column_values, int no_cols, int no_entries, WORD table_key, uuid_t *txnid, remote_db_t *db) {
+    enqueues++;
+    for (int i = 0; i < no_entries && enq_count < MAX_CALLS; i++) {
+        enq_dests[enq_count] = (long)queue_ids[i];
+        enq_keys[enq_count++] = (long)column_values[i];
+    }
+    return 0;
+}
+
+int fake_consume_advance_queue_in_txn(WORD consumer_id, WORD shard_id, WORD app_id, WORD table_key, WORD queue_id,
+                                      int max_entries, int64_t *new_consume_head, uuid_t *txnid, remote_db_t *db) {
+    if (consumes < MAX_CALLS) {
+        cons_queues[consumes] = (long)queue_id;
+        cons_counts[consumes] = max_entries;
+    }
+    consumes++;
+    return 0;
+}
+
+// A step of "a" on a message with "baseline", sending "outgoing".
+struct $Step *new_step($Actor a, bool consume, time_t baseline, $Msg outgoing, $Msg done) {
+    struct $Step *s = $alloc(sizeof(struct $Step));
+    s->rows = NULL;
+    snapshot(s, ($Serializable)a, a->$globkey, ACTORS_TABLE);
+    s->consume = consume;
+    s->queue = a->$globkey;
+    s->outgoing = outgoing;
+    s->baseline = baseline;
+    s->done = done;
+    s->value = $None;
+    return s;
+}
+
+$Msg new_msg($Actor to, time_t baseline, $Msg next) {
+    $Msg m = $NEW($Msg, to, ($Cont)&$Done$instance, baseline, $None);
+    m->$next = next;
+    return m;
+}
+
+// Two steps of one actor, an await of another, an expired and a cancelled
+// timer, committed as one batch after one failed attempt.
+void test_batch() {
+    pipe(wakeup_pipe);
+    time_t now = current_time();
+    $Actor a = $NEW($Actor), b = $NEW($Actor);
+    receiver = $NEW($Actor);
+    ENQ_msg(new_msg(receiver, now, NULL), receiver);       // not made ready by the deliveries below
+
+    $Msg m1 = new_msg(receiver, now, NULL);
+    $Msg timed = new_msg(receiver, now + 1 + 60000000, NULL);
+    $Msg m2 = new_msg(receiver, now + 1, timed);
+    $Msg done = new_msg(a, now, NULL);
+    $Msg expired = new_msg(receiver, now + 2, NULL);
+    $Msg cancelled = new_msg(receiver, now + 3, NULL);
+
+    struct $Step *s1 = new_step(a, true, now, m1, done);
+    struct $Step *s2 = new_step(a, true, now + 1, m2, NULL);
+    struct $Step *s3 = new_step(b, false, now, NULL, NULL);
+    s1->next = s2;
+    s2->next = s3;
+    COMMIT_timer(expired, false);
+    COMMIT_timer(cancelled, true);
+    s3->next = commitQ;
+    commitQ = commitQ_tail = NULL;
+
+    fail_commits = 1;
+    commit_batch(s1, 5);
+
+    CHECK(txns == 2 && commits == 1, "%d transactions and %d commits, expected 2 and 1", txns, commits);
+    CHECK(inserts == 3, "%d rows written, expected 3", inserts);
+    CHECK(enqueues == 1, "%d enqueue calls, expected 1", enqueues);
+    long dests[] = {receiver->$globkey, receiver->$globkey, TIMER_QUEUE, receiver->$globkey};
+    long keys[] = {m1->$globkey, m2->$globkey, timed->$globkey, expired->$globkey};
+    CHECK(enq_count == 4, "%d messages enqueued, expected 4", enq_count);
+    for (int i = 0; i < 4 && i < enq_count; i++)
+        CHECK(enq_dests[i] == dests[i] && enq_keys[i] == keys[i],
+              "message %d enqueued as %ld on queue %ld, expected %ld on queue %ld", i, enq_keys[i], enq_dests[i], keys[i], dests[i]);
+    CHECK(consumes == 2, "%d consume calls, expected 2", consumes);
+    for (int i = 0; i < 2 && i < consumes; i++) {
+        long q = i == 0 ? a->$globkey : TIMER_QUEUE;
+        CHECK(cons_queues[i] == q && cons_counts[i] == 2,
+              "consumed %d from queue %ld, expected 2 from queue %ld", cons_counts[i], cons_queues[i], q);
+    }
+    CHECK(delivered_at_commit == 1, "%ld messages delivered before the commit", delivered_at_commit - 1);
+
+    $Msg x = receiver->$msg->$next;
+    CHECK(x == m1 && x->$next == m2 && m2->$next == expired && !expired->$next, "messages not delivered in order");
+    CHECK(timerQ.count == 1, "%ld timed messages, expected 1", timerQ.count);
+    CHECK(done->$cont == NULL, "completed message not frozen");
+    CHECK(commitQ == NULL, "steps left in the commit queue");
+}
+
+int main() {
+    test_batch();
+    if (failures) {
+        printf("%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
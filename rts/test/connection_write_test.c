@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Connection.write to a slow reader. The writer awaits each write in turn, so
+ * while the reader holds off, the writes must stop completing once more than
+ * OUTQ_HIGH bytes are queued, and go on once the reader catches up. The close
+ * that follows the last write must wait until all of it has been written out.
+ */
+
+#include "../rts.c"
+#include <netinet/in.h>
+
+#define CHUNK   (64*1024)
+#define CHUNKS  256
+#define PAUSE   300000                  // usec the reader holds off before reading
+
+int port;
+_Atomic int completed = 0;              // writes completed so far
+_Atomic int completed_at_resume = -1;
+_Atomic long queued_max = 0;            // most output queued when a write completed
+
+struct Writer {
+    struct $Cont$class *$class;
+    $Connection conn;
+    int i;
+};
+struct $Cont$class Start$methods, Written$methods;
+
+$str chunk(int i) {
+    $str s = malloc(sizeof(struct $str));
+    s->$class = &$str$methods;
+    s->str = malloc(CHUNK + 1);
+    s->nbytes = s->nchars = CHUNK;
+    for (int j = 0; j < CHUNK; j++)
+        s->str[j] = 'a' + ((long)i * CHUNK + j) % 26;
+    s->str[CHUNK] = 0;
+    return s;
+}
+
+// Issue write number "i", and continue with Written once it completes.
+$R write_next($Connection conn, int i) {
+    if (i == CHUNKS) {
+        conn->$class->close(conn);
+        return $R_CONT(($Cont)&$Done$instance, $None);
+    }
+    $Msg m = conn->$class->write(conn, chunk(i));
+    struct Writer *k = malloc(sizeof(struct Writer));
+    k->$class = &Written$methods;
+    k->conn = conn;
+    k->i = i + 1;
+    return $AWAIT(m, ($Cont)k);
+}
+
+$R Start$call(struct Writer *k, $Cont then) {
+    return write_next(k->conn, 0);
+}
+
+$R Written$call(struct Writer *k, $WORD value) {
+    struct FileDescriptorData *d = &fd_data[k->conn->descriptor];
+    pthread_mutex_lock(&d->out_lock);
+    if (d->out_len > queued_max)
+        queued_max = d->out_len;
+    pthread_mutex_unlock(&d->out_lock);
+    completed++;
+    return write_next(k->conn, k->i);
+}
+
+struct $function$class Accept$methods;
+struct $function accept_f = { &Accept$methods };
+bool listen_failed;
+
+$WORD Accept$call($function f, $Connection c) {
+    if (!c) {
+        listen_failed = true;
+        return $None;
+    }
+    int sndbuf = 64 * 1024;
+    setsockopt(c->descriptor, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+    $Actor writer = $NEW($Actor);
+    struct Writer *k = malloc(sizeof(struct Writer));
+    k->$class = &Start$methods;
+    k->conn = c;
+    k->i = 0;
+    $ASYNC(writer, ($Cont)k);
+    return $None;
+}
+
+void *reader(void *arg) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 16 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    struct sockaddr_in a = { .sin_family = AF_INET, .sin_port = htons(port) };
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&a, sizeof a) < 0) {
+        perror("connect");
+        _exit(1);
+    }
+    usleep(PAUSE);
+    completed_at_resume = completed;
+    char buf[16384];
+    long total = 0;
+    int r;
+    while ((r = read(fd, buf, sizeof buf)) > 0) {
+        for (int j = 0; j < r; j++)
+            if (buf[j] != 'a' + (total + j) % 26) {
+                printf("FAIL: wrong byte at offset %ld\n", total + j);
+                _exit(1);
+            }
+        total += r;
+    }
+    int fails = 0;
+    if (completed_at_resume >= CHUNKS) {
+        printf("FAIL: all %d writes completed while the reader held off\n", CHUNKS);
+        fails++;
+    }
+    if (queued_max > OUTQ_HIGH) {
+        printf("FAIL: a write completed with %ld bytes queued\n", queued_max);
+        fails++;
+    }
+    if (completed != CHUNKS) {
+        printf("FAIL: %d of %d writes completed at close\n", completed, CHUNKS);
+        fails++;
+    }
+    if (total != (long)CHUNK * CHUNKS) {
+        printf("FAIL: read %ld of %ld bytes before close\n", total, (long)CHUNK * CHUNKS);
+        fails++;
+    }
+    if (!fails)
+        printf("OK: %d writes, %d completed while the reader held off, %ld bytes read\n", CHUNKS, completed_at_resume, total);
+    fflush(stdout);
+    _exit(fails ? 1 : 0);
+}
+
+void $ROOTINIT() {
+    Accept$methods = $function$methods;
+    Accept$methods.__call__ = ($WORD (*)($function, ...))Accept$call;
+    Start$methods = $Cont$methods;
+    Start$methods.__call__ = ($R (*)($Cont, ...))Start$call;
+    Written$methods = $Cont$methods;
+    Written$methods.__call__ = ($R (*)($Cont, ...))Written$call;
+}
+
+// Listen on the first free port from a pid dependent start, and then connect.
+$R $ROOT($Env env, $Cont then) {
+    for (port = 20000 + getpid() % 20000; ; port++) {
+        listen_failed = false;
+        env->$class->listen$local(env, to$int(port), &accept_f, then);
+        if (!listen_failed)
+            break;
+    }
+    pthread_t t;
+    pthread_create(&t, NULL, reader, NULL);
+    return $R_CONT(then, $None);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Priorities under --rts-edf, with one worker thread. The root actor queues a
+ * backlog of work on LOWS actors of priority 0, each taking WORK usec, and then
+ * suspends for a while before it sends to an actor of priority PRIO. That actor
+ * must run before the rest of the backlog, and the root actor must itself be
+ * woken before it, or else all the backlog would have run in the meantime.
+ */
+
+#include "../rts.c"
+
+#define LOWS    100
+#define WORK    2000                    // usec of work per low priority actor
+#define PAUSE   20000                   // usec the root actor suspends
+#define PRIO    10
+
+_Atomic int lows_done = 0;
+
+struct Job {
+    struct $Cont$class *$class;
+    $Actor high;
+};
+struct $Cont$class Low$methods, High$methods, Resume$methods;
+
+$R Low$call(struct Job *k, $Cont then) {
+    usleep(WORK);
+    lows_done++;
+    return $R_CONT(then, $None);
+}
+
+$R High$call(struct Job *k, $Cont then) {
+    int before = lows_done;
+    if (before >= LOWS / 2) {
+        printf("FAIL: %d of %d low priority actors ran before the high priority one\n", before, LOWS);
+        fflush(stdout);
+        _exit(1);
+    }
+    printf("OK: %d of %d low priority actors ran before the high priority one\n", before, LOWS);
+    fflush(stdout);
+    _exit(0);
+}
+
+$R Resume$call(struct Job *k, $WORD value) {
+    struct Job *j = malloc(sizeof(struct Job));
+    j->$class = &High$methods;
+    $ASYNC(k->high, ($Cont)j);
+    return $R_CONT(($Cont)&$Done$instance, $None);
+}
+
+void $ROOTINIT() {
+    Low$methods = $Cont$methods;
+    Low$methods.__call__ = ($R (*)($Cont, ...))Low$call;
+    High$methods = $Cont$methods;
+    High$methods.__call__ = ($R (*)($Cont, ...))High$call;
+    Resume$methods = $Cont$methods;
+    Resume$methods.__call__ = ($R (*)($Cont, ...))Resume$call;
+}
+
+$R $ROOT($Env env, $Cont then) {
+    if (!rts_edf) {
+        printf("FAIL: run with --rts-edf\n");
+        exit(1);
+    }
+    $wctx.current->$prio = PRIO;
+    for (int i = 0; i < LOWS; i++) {
+        struct Job *j = malloc(sizeof(struct Job));
+        j->$class = &Low$methods;
+        $ASYNC($NEW($Actor), ($Cont)j);
+    }
+    struct Job *k = malloc(sizeof(struct Job));
+    k->$class = &Resume$methods;
+    k->high = $NEW($Actor);
+    k->high->$prio = PRIO;
+    return $SUSPEND(PAUSE, ($Cont)k);
+}
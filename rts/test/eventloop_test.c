@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Many clients that start writing at once to connections of the same listener.
+ * Every byte must arrive, in order per connection. epoll_wait is wrapped to
+ * see which eventloop is actually in use, and that a single wait harvests
+ * more than one event. With several eventloops, the connections must be
+ * spread over them.
+ */
+
+#include "../rts.c"
+#include <netinet/in.h>
+#include <sys/epoll.h>
+
+#define CLIENTS 32
+#define MSGS    200
+#define LEN     100                     // bytes per message
+#define TOTAL   ((long)CLIENTS * MSGS * LEN)
+#define MAX_LOOPS 64
+
+int port;
+pthread_mutex_t connecting = PTHREAD_MUTEX_INITIALIZER;
+pthread_barrier_t start;
+_Atomic long received = 0;
+_Atomic int epoll_waits = 0;
+_Atomic int most_ready = 0;             // most events returned by one epoll_wait
+long offset[MAX_FD];                    // bytes received so far on each descriptor
+_Atomic int per_loop[MAX_LOOPS];        // connections accepted by each eventloop
+bool listen_failed;
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    epoll_waits++;
+    int n = syscall(SYS_epoll_pwait, epfd, events, maxevents, timeout, NULL, 8);    // no sigmask
+    if (n > most_ready)
+        most_ready = n;
+    return n;
+}
+
+void finish() {
+    int fails = 0;
+    if (rts_io_uring && epoll_waits) {
+        printf("FAIL: epoll_wait called %d times with --rts-io-uring\n", (int)epoll_waits);
+        fails++;
+    }
+    if (!rts_io_uring && most_ready < 2) {
+        printf("FAIL: epoll_wait returned at most %d event(s) at a time\n", (int)most_ready);
+        fails++;
+    }
+    int loops = 0;
+    for (int i = 0; i < MAX_LOOPS; i++)
+        loops += per_loop[i] > 0;
+    if (rts_eventloops > 1 && loops < 2) {
+        printf("FAIL: all connections on one of %ld eventloops\n", rts_eventloops);
+        fails++;
+    }
+    if (!fails)
+        printf("OK: %ld bytes from %d clients on %d eventloop(s)%s\n", TOTAL, CLIENTS, loops, rts_io_uring ? " with io_uring" : "");
+    fflush(stdout);
+    _exit(fails ? 1 : 0);
+}
+
+struct Recv {
+    struct $function$class *$class;
+    int fd;
+};
+struct $function$class Accept$methods, Recv$methods, Err$methods;
+struct $function accept_f = { &Accept$methods }, err_f = { &Err$methods };
+
+$WORD Recv$call(struct Recv *f, $str s) {
+    for (int j = 0; j < s->nbytes; j++)
+        if (s->str[j] != 'a' + (offset[f->fd] + j) % 26) {
+            printf("FAIL: wrong byte at offset %ld of descriptor %d\n", offset[f->fd] + j, f->fd);
+            fflush(stdout);
+            _exit(1);
+        }
+    offset[f->fd] += s->nbytes;
+    if ((received += s->nbytes) == TOTAL)
+        finish();
+    return $None;
+}
+
+$WORD Err$call($function f, $str s) {
+    printf("FAIL: error on a connection\n");
+    fflush(stdout);
+    _exit(1);
+}
+
+$WORD Accept$call($function f, $Connection c) {
+    if (!c) {
+        listen_failed = true;
+        return $None;
+    }
+    if (fd_data[c->descriptor].loop < MAX_LOOPS)
+        per_loop[fd_data[c->descriptor].loop]++;
+    struct Recv *r = malloc(sizeof(struct Recv));
+    r->$class = &Recv$methods;
+    r->fd = c->descriptor;
+    c->$class->on_receipt(c, ($function)r, &err_f);
+    return $None;
+}
+
+void *client(void *arg) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in a = { .sin_family = AF_INET, .sin_port = htons(port) };
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // One at a time, since the listen backlog is short
+    pthread_mutex_lock(&connecting);
+    if (connect(fd, (struct sockaddr *)&a, sizeof a) < 0) {
+        perror("connect");
+        _exit(1);
+    }
+    pthread_mutex_unlock(&connecting);
+    char buf[LEN];
+    pthread_barrier_wait(&start);
+    for (long i = 0; i < MSGS; i++) {
+        for (int j = 0; j < LEN; j++)
+            buf[j] = 'a' + (i * LEN + j) % 26;
+        write(fd, buf, LEN);
+    }
+    pause();
+    return NULL;
+}
+
+void *watchdog(void *arg) {
+    sleep(20);
+    printf("FAIL: %ld of %ld bytes received\n", (long)received, TOTAL);
+    fflush(stdout);
+    _exit(1);
+}
+
+void $ROOTINIT() {
+    Accept$methods = $function$methods;
+    Accept$methods.__call__ = ($WORD (*)($function, ...))Accept$call;
+    Recv$methods = $function$methods;
+    Recv$methods.__call__ = ($WORD (*)($function, ...))Recv$call;
+    Err$methods = $function$methods;
+    Err$methods.__call__ = ($WORD (*)($function, ...))Err$call;
+}
+
+// Listen on the first free port from a pid dependent start, and then connect.
+$R $ROOT($Env env, $Cont then) {
+    for (port = 20000 + getpid() % 20000; ; port++) {
+        listen_failed = false;
+        env->$class->listen$local(env, to$int(port), &accept_f, then);
+        if (!listen_failed)
+            break;
+    }
+    pthread_t t;
+    pthread_barrier_init(&start, NULL, CLIENTS);
+    for (int i = 0; i < CLIENTS; i++)
+        pthread_create(&t, NULL, client, NULL);
+    pthread_create(&t, NULL, watchdog, NULL);
+    return $R_CONT(then, $None);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Env.listen where the bind of the last eventloop fails. bind is wrapped to
+ * fail it. The callback must get None once, and the listeners of the loops
+ * before must be taken down, so that nothing is left listening on the port.
+ */
+
+#include "../rts.c"
+#include <netinet/in.h>
+
+int port;
+int binds = 0;                          // by listen$local
+int fail_at = 0;                        // fail bind number fail_at, 0 for none
+int bound[MAX_FD];                      // the descriptors bound
+int nones = 0, connections = 0;
+
+int bind(int fd, const struct sockaddr *addr, socklen_t len) {
+    if (fail_at) {
+        if (++binds == fail_at) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        bound[binds - 1] = fd;
+    }
+    return syscall(SYS_bind, fd, addr, len);
+}
+
+struct $function$class Accept$methods;
+struct $function accept_f = { &Accept$methods };
+
+$WORD Accept$call($function f, $Connection c) {
+    if (c)
+        connections++;
+    else
+        nones++;
+    return $None;
+}
+
+// Find a port that nothing listens on, so that a refused connect means
+// something.
+int free_port() {
+    for (int p = 20000 + getpid() % 20000; ; p++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in a = { .sin_family = AF_INET, .sin_port = htons(p) };
+        a.sin_addr.s_addr = INADDR_ANY;
+        int r = bind(fd, (struct sockaddr *)&a, sizeof a);
+        close(fd);
+        if (r == 0)
+            return p;
+    }
+}
+
+void $ROOTINIT() {
+    Accept$methods = $function$methods;
+    Accept$methods.__call__ = ($WORD (*)($function, ...))Accept$call;
+}
+
+$R $ROOT($Env env, $Cont then) {
+    port = free_port();
+    fail_at = rts_eventloops;
+    env->$class->listen$local(env, to$int(port), &accept_f, then);
+    int fails = 0;
+    if (nones != 1 || connections) {
+        printf("FAIL: listen callback got None %d times and %d connections, expected once and none\n", nones, connections);
+        fails++;
+    }
+    for (int i = 0; i < binds - 1; i++)
+        if (fd_data[bound[i]].kind != nohandler) {
+            printf("FAIL: listener of loop %d not taken down\n", i);
+            fails++;
+        }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in a = { .sin_family = AF_INET, .sin_port = htons(port) };
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&a, sizeof a) == 0) {
+        printf("FAIL: connected to the port after the failed listen\n");
+        fails++;
+    }
+    if (!fails)
+        printf("OK: failed listen on %ld loop(s) left nothing listening\n", rts_eventloops);
+    fflush(stdout);
+    _exit(fails ? 1 : 0);
+}
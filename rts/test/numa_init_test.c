@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Unit tests of the grouping of workers per NUMA node. The RTS is included
+ * whole and never started, and numa_init reads a made up node directory.
+ */
+
+#define main rts_main
+#include "../rts.c"
+#undef main
+
+#include <sys/stat.h>
+
+void $ROOTINIT() {}
+$R $ROOT($Env env, $Cont then) { return $R_CONT(then, $None); }
+
+int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+char sysfs[] = "/tmp/numa_init_test.XXXXXX";
+
+void write_file(char *name, char *content) {
+    char path[300];
+    snprintf(path, sizeof(path), "%s/%s", sysfs, name);
+    char *slash = strrchr(path, '/');
+    *slash = 0;
+    mkdir(path, 0700);
+    *slash = '/';
+    FILE *f = fopen(path, "w");
+    fputs(content, f);
+    fclose(f);
+}
+
+void remove_sysfs() {
+    char cmd[300];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", sysfs);
+    system(cmd);
+}
+
+// Check that there are "count" nodes, and that node i has the workers pinned
+// to the CPUs in "expected[i]", ended by -1.
+void check_nodes(int count, int expected[][9]) {
+    CHECK(num_nodes == count, "%ld nodes, expected %d", num_nodes, count);
+    long w = 0;
+    for (int i = 0; i < count && i < num_nodes; i++) {
+        CHECK(nodes[i].first == w, "node %d starts at worker %ld, expected %ld", i, nodes[i].first, w);
+        int n = 0;
+        while (expected[i][n] >= 0)
+            n++;
+        CHECK(nodes[i].count == n, "node %d has %ld workers, expected %d", i, nodes[i].count, n);
+        for (int j = 0; j < n && j < nodes[i].count; j++)
+            CHECK(wt_cpu[w + j] == expected[i][j], "worker %ld of node %d is on CPU %d, expected %d",
+                  w + j, i, wt_cpu[w + j], expected[i][j]);
+        w += nodes[i].count;
+    }
+}
+
+void test_parse_cpulist() {
+    bool set[MAX_CPUS] = {false};
+    CHECK(parse_cpulist("0-3,8-11\n", set) == 8, "wrong count for 0-3,8-11");
+    CHECK(set[0] && set[3] && !set[4] && set[8] && set[11] && !set[12], "wrong CPUs for 0-3,8-11");
+    bool set2[MAX_CPUS] = {false};
+    CHECK(parse_cpulist("5,5,4-5", set2) == 2, "CPUs counted twice");
+    bool set3[MAX_CPUS] = {false};
+    CHECK(parse_cpulist("1-", set3) == -1, "accepted 1-");
+    CHECK(parse_cpulist("x", set3) == -1, "accepted x");
+    CHECK(parse_cpulist("1;2", set3) == -1, "accepted 1;2");
+}
+
+// Two nodes with interleaved CPUs, and a file that is not a node
+void test_nodes() {
+    write_file("node0/cpulist", "0-1,4-5\n");
+    write_file("node1/cpulist", "2-3,6-7\n");
+    write_file("possible", "0-1\n");
+    int all[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    numa_init(8, all, 8, true);
+    check_nodes(2, (int[][9]){{0, 1, 4, 5, -1}, {2, 3, 6, 7, -1}});
+
+    int some[] = {1, 2, 3};
+    numa_init(3, some, 3, true);
+    check_nodes(2, (int[][9]){{1, -1}, {2, 3, -1}});
+
+    int second[] = {6, 7};                              // node0 gets no workers
+    numa_init(2, second, 2, true);
+    check_nodes(1, (int[][9]){{6, 7, -1}});
+    CHECK(nodes[0].heap_len == 0 && !nodes[0].head, "node not initialized");
+}
+
+// Without pinning, or without the node directory, there is a single node
+void test_single() {
+    int all[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    numa_init(5, all, 8, false);
+    CHECK(num_nodes == 1 && nodes[0].first == 0 && nodes[0].count == 5,
+          "%ld nodes, the first with %ld workers, expected 1 with 5", num_nodes, nodes[0].count);
+    for (int i = 0; i < 5; i++)
+        CHECK(wt_cpu[i] == -1, "worker %d pinned to CPU %d", i, wt_cpu[i]);
+    remove_sysfs();
+    numa_init(8, all, 8, true);
+    check_nodes(1, (int[][9]){{0, 1, 2, 3, 4, 5, 6, 7, -1}});
+}
+
+int main() {
+    if (!mkdtemp(sysfs)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    numa_sysfs = sysfs;
+    test_parse_cpulist();
+    test_nodes();
+    test_single();
+    remove_sysfs();
+    if (failures) {
+        printf("%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Unit tests of the work-stealing deques of the worker threads. The RTS is
+ * included whole, so that the static deque operations can be reached, and it
+ * is never started.
+ */
+
+#define main rts_main
+#include "../rts.c"
+#undef main
+
+void $ROOTINIT() {}
+$R $ROOT($Env env, $Cont then) { return $R_CONT(then, $None); }
+
+int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+#define ITEMS   1000000
+#define THIEVES 4
+
+struct $Actor items[ITEMS];
+_Atomic int taken[ITEMS];               // times each item was returned by pop or steal
+_Atomic long steals = 0;
+_Atomic bool owner_done = false;
+
+void take($Actor a) {
+    taken[a - items]++;
+}
+
+// Without thieves, the owner pops in LIFO order and a thief steals in FIFO
+// order, also across arrays that had to grow.
+void test_order() {
+    long n = 3 * RQ_INITIAL_SIZE;
+    rq_init(1);
+    for (long i = 0; i < n; i++)
+        rq_push(&rqs[0], &items[i]);
+    for (long i = 0; i < n / 2; i++) {
+        $Actor a = rq_steal(&rqs[0]);
+        CHECK(a == &items[i], "steal %ld returned item %ld", i, a ? (long)(a - items) : -1L);
+    }
+    for (long i = n - 1; i >= n / 2; i--) {
+        $Actor a = rq_pop(&rqs[0]);
+        CHECK(a == &items[i], "pop returned item %ld, expected %ld", a ? (long)(a - items) : -1L, i);
+    }
+    CHECK(rq_pop(&rqs[0]) == NULL, "pop from an empty deque");
+    CHECK(rq_steal(&rqs[0]) == NULL, "steal from an empty deque");
+}
+
+void *thief(void *arg) {
+    while (true) {
+        bool done = owner_done;
+        $Actor a = rq_steal(&rqs[0]);
+        if (a) {
+            take(a);
+            steals++;
+        } else if (done) {
+            return NULL;
+        }
+    }
+}
+
+// The owner pushes and pops while THIEVES threads steal. The deque often holds
+// a single item, so that pops race with steals for the last one, and it grows
+// now and then. Every item must be taken exactly once.
+void test_race() {
+    rq_init(1);
+    pthread_t t[THIEVES];
+    for (int i = 0; i < THIEVES; i++)
+        pthread_create(&t[i], NULL, thief, NULL);
+    unsigned int r = 1;
+    long next = 0;
+    while (next < ITEMS) {
+        long burst = rand_r(&r) % 8 == 0 ? rand_r(&r) % (2 * RQ_INITIAL_SIZE) : 1 + rand_r(&r) % 2;
+        for (long i = 0; i < burst && next < ITEMS; i++)
+            rq_push(&rqs[0], &items[next++]);
+        long pops = rand_r(&r) % (burst + 1);
+        for (long i = 0; i < pops; i++) {
+            $Actor a = rq_pop(&rqs[0]);
+            if (a)
+                take(a);
+        }
+    }
+    $Actor a;
+    while ((a = rq_pop(&rqs[0])))
+        take(a);
+    owner_done = true;
+    for (int i = 0; i < THIEVES; i++)
+        pthread_join(t[i], NULL);
+    long lost = 0, dups = 0;
+    for (long i = 0; i < ITEMS; i++) {
+        if (taken[i] == 0)
+            lost++;
+        else if (taken[i] > 1)
+            dups++;
+    }
+    CHECK(lost == 0, "%ld of %d items never taken", lost, ITEMS);
+    CHECK(dups == 0, "%ld of %d items taken more than once", dups, ITEMS);
+    CHECK(steals > 0, "no item was stolen");
+}
+
+int main() {
+    test_order();
+    test_race();
+    if (failures) {
+        printf("%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("OK: %ld of %d items stolen\n", (long)steals, ITEMS);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2019-2021 Data Ductus AB
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Unit tests of the timing wheel. The RTS is included whole, so that the
+ * static wheel helpers can be reached, and it is never started.
+ */
+
+#define main rts_main
+#include "../rts.c"
+#undef main
+
+void $ROOTINIT() {}
+$R $ROOT($Env env, $Cont then) { return $R_CONT(then, $None); }
+
+int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+$Msg new_timed(int64_t tick) {
+    $Msg m = calloc(1, sizeof(struct $Msg));
+    m->$class = &$Msg$methods;
+    m->$cont = ($Cont)&$Done$instance;
+    m->$baseline = tick * TW_TICK;
+    atomic_flag_clear(&m->$wait_lock);
+    return m;
+}
+
+// Return the level of the wheel slot holding "m", or -1 if it is not in the wheel.
+int find_level($Msg m, int *idx) {
+    for (int l = 0; l < TW_LEVELS; l++)
+        for (int i = 0; i < TW_SLOTS; i++)
+            for ($Msg x = timerQ.slot[l][i]; x; x = x->$next)
+                if (x == m) {
+                    *idx = i;
+                    return l;
+                }
+    return -1;
+}
+
+int list_length($Msg list) {
+    int n = 0;
+    for (; list; list = list->$next)
+        n++;
+    return n;
+}
+
+// Start every test from an empty wheel positioned at a tick where all bit
+// groups are zero, far enough ahead of the clock that ENQ_timed never moves it.
+int64_t reset_wheel() {
+    memset(&timerQ, 0, sizeof timerQ);
+    int64_t span = (int64_t)1 << (TW_BITS * TW_LEVELS);
+    timerQ.tick = (current_time() / TW_TICK / span + 1) * span;
+    return timerQ.tick;
+}
+
+// A message goes to the lowest level whose span covers its distance from the
+// wheel position, and anything beyond the top level is parked in its last slot.
+void test_insert() {
+    int64_t base = reset_wheel();
+    struct { int64_t delta; int level; int idx; } cases[] = {
+        { 0, 0, 0 },
+        { 1, 0, 1 },
+        { 63, 0, 63 },
+        { 64, 1, 1 },
+        { 4095, 1, 63 },
+        { 4096, 2, 1 },
+        { ((int64_t)5 << 18) + 7, 3, 5 },
+        { ((int64_t)9 << 24) + 3, 4, 9 },
+        { ((int64_t)17 << 30) + 5, 5, 17 },
+        { ((int64_t)1 << 36) - 1, 5, 63 },
+        { ((int64_t)1 << 36) + 5, 5, 63 },
+        { (int64_t)1 << 44, 5, 63 },
+        { -5, 0, 0 },
+    };
+    int n = sizeof cases / sizeof cases[0];
+    for (int k = 0; k < n; k++) {
+        $Msg m = new_timed(base + cases[k].delta);
+        ENQ_timed(m);
+        int idx = -1;
+        int l = find_level(m, &idx);
+        CHECK(l == cases[k].level && idx == cases[k].idx, "delta %ld stored at level %d slot %d, expected level %d slot %d",
+              cases[k].delta, l, idx, cases[k].level, cases[k].idx);
+        CHECK(timerQ.occupied[l] & ((uint64_t)1 << idx), "delta %ld: slot not marked occupied", cases[k].delta);
+    }
+    CHECK(timerQ.count == n, "count is %ld, expected %d", timerQ.count, n);
+    CHECK(tw_next_tick() == base, "next tick is %ld, expected %ld", tw_next_tick(), base);
+}
+
+// Advancing the wheel one due tick at a time must cascade every message down
+// through the levels and expire it exactly at its tick, never a tick early.
+void test_cascade() {
+    int64_t base = reset_wheel();
+    int64_t deltas[] = { 1, 63, 64, 65, 127, 4095, 4096, 4097, 262143, 262144, 300000,
+                         (int64_t)1 << 24, ((int64_t)1 << 30) + 1, ((int64_t)1 << 36) - 1,
+                         ((int64_t)1 << 36) + 1, ((int64_t)3 << 36) + 4711 };
+    int n = sizeof deltas / sizeof deltas[0];
+    $Msg msgs[n];
+    for (int k = 0; k < n; k++) {
+        msgs[k] = new_timed(base + deltas[k]);
+        ENQ_timed(msgs[k]);
+    }
+    for (int k = 0; k < n; k++) {
+        int64_t due = base + deltas[k];
+        $Msg early = DEQ_timed(due * TW_TICK - 1);
+        CHECK(early == NULL, "delta %ld: %d message(s) expired before tick %ld", deltas[k], list_length(early), due);
+        $Msg res = DEQ_timed(due * TW_TICK);
+        CHECK(res == msgs[k] && res->$next == NULL, "delta %ld: expected exactly its own message at its tick", deltas[k]);
+        CHECK(timerQ.count == n - k - 1, "delta %ld: count is %ld, expected %d", deltas[k], timerQ.count, n - k - 1);
+    }
+    CHECK(tw_next_tick() == -1, "wheel not empty after expiring everything");
+}
+
+// A jump of the clock far beyond every timer expires them all at once, ordered
+// on their baselines and with equal baselines in insertion order.
+void test_jump() {
+    int64_t base = reset_wheel();
+    int64_t deltas[] = { (int64_t)1 << 40, 70, 5, 70, 4096 * 64 + 1, 5, ((int64_t)1 << 36) + 1, 0 };
+    int n = sizeof deltas / sizeof deltas[0];
+    $Msg msgs[n];
+    for (int k = 0; k < n; k++) {
+        msgs[k] = new_timed(base + deltas[k]);
+        ENQ_timed(msgs[k]);
+    }
+    $Msg res = DEQ_timed((base + ((int64_t)1 << 41)) * TW_TICK);
+    CHECK(list_length(res) == n, "expired %d messages, expected %d", list_length(res), n);
+    int order[] = { 7, 2, 5, 1, 3, 4, 6, 0 };
+    for (int k = 0; k < n && res; k++, res = res->$next)
+        CHECK(res == msgs[order[k]], "message %d expired out of order", k);
+    CHECK(timerQ.count == 0, "count is %ld after expiring everything", timerQ.count);
+}
+
+// Cancelling unlinks a message from the middle or the end of its slot, also
+// after it has been cascaded to a lower level, but not once it has expired.
+void test_cancel() {
+    int64_t base = reset_wheel();
+    $Msg a = new_timed(base + 4100), b = new_timed(base + 4100), c = new_timed(base + 4100);
+    ENQ_timed(a);
+    ENQ_timed(b);
+    ENQ_timed(c);
+    CHECK(CANCEL_timed(b), "could not cancel a message in the middle of a slot");
+    CHECK(CANCEL_timed(c), "could not cancel the last message of a slot");
+    CHECK(!CANCEL_timed(c), "cancelled a message twice");
+    $Msg d = new_timed(base + 4100);
+    ENQ_timed(d);
+    CHECK(timerQ.count == 2, "count is %ld, expected 2", timerQ.count);
+    CHECK(DEQ_timed((base + 4096) * TW_TICK) == NULL, "expired messages before their tick");
+    int idx;
+    CHECK(find_level(a, &idx) == 0, "message not cascaded down to level 0");
+    CHECK(CANCEL_timed(a), "could not cancel a cascaded message");
+    $Msg res = DEQ_timed((base + 4100) * TW_TICK);
+    CHECK(res == d && d->$next == NULL, "expected only the message queued after the cancellations");
+    CHECK(!CANCEL_timed(d), "cancelled an expired message");
+    CHECK(b->$cont == NULL && b->$value == $None, "cancelled message not frozen with None");
+    CHECK(timerQ.count == 0, "count is %ld, expected 0", timerQ.count);
+}
+
+int main() {
+    test_insert();
+    test_cascade();
+    test_jump();
+    test_cancel();
+    if (failures) {
+        printf("%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
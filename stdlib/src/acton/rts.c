@@ -5,6 +5,20 @@ $NoneType acton$rts$$sleep ($float sleep_time) {
     usleep(to_sleep);
     return $None;
 }
+$R acton$rts$$suspend ($float sleep_time, $Cont c$cont) {
+    return $SUSPEND(sleep_time->val*1000000, c$cont);
+}
+$R acton$rts$$set_mailbox_capacity ($int cap, $Cont c$cont) {
+    __atomic_store_n(&$wctx.current->$mbox_cap, cap->val, __ATOMIC_RELAXED);
+    return $R_CONT(c$cont, $None);
+}
+$R acton$rts$$mailbox_depth ($Cont c$cont) {
+    return $R_CONT(c$cont, to$int(__atomic_load_n(&$wctx.current->$mbox_len, __ATOMIC_RELAXED)));
+}
+$R acton$rts$$set_priority ($int prio, $Cont c$cont) {
+    $wctx.current->$prio = prio->val;
+    return $R_CONT(c$cont, $None);
+}
 int acton$rts$$done$ = 0;
 void acton$rts$$__init__ () {
     if (acton$rts$$done$) return;
@@ -3,4 +3,8 @@
 #include "builtin/minienv.h"
 #include "rts/rts.h"
 $NoneType acton$rts$$sleep ($float);
+$R acton$rts$$suspend ($float, $Cont);
+$R acton$rts$$set_mailbox_capacity ($int, $Cont);
+$R acton$rts$$mailbox_depth ($Cont);
+$R acton$rts$$set_priority ($int, $Cont);
 void acton$rts$$__init__ ();